@@ -0,0 +1,43 @@
+#include "corpus.h"
+
+/* Writes a generated corpus to stdout or to a file */
+int main(int argc, char **argv)
+{
+    enum corpus_kind kind;
+    size_t size, length;
+    FILE *out = stdout;
+    char *buf;
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <kind> <megabytes> [file] [seed]\n"
+                        "kinds: huge tiny long comments quoted mixed\n",
+                argv[0]);
+        return 2;
+    }
+
+    if ((kind = corpus_kind_by_name(argv[1])) == CORPUS_KIND_COUNT) {
+        fprintf(stderr, "unknown corpus kind: %s\n", argv[1]);
+        return 2;
+    }
+
+    size = (size_t) (atof(argv[2]) * 1024 * 1024);
+    buf = corpus_generate(kind, size, argc > 4 ? strtoull(argv[4], NULL, 0)
+                                               : 0, &length);
+
+    if (buf == NULL)
+        return 1;
+
+    if (argc > 3 && (out = fopen(argv[3], "wb")) == NULL) {
+        perror(argv[3]);
+        free(buf);
+        return 1;
+    }
+
+    fwrite(buf, 1, length, out);
+
+    if (out != stdout)
+        fclose(out);
+
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,267 @@
+#ifndef INI_BENCH_CORPUS_H
+#define INI_BENCH_CORPUS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/**
+ * Shapes of the generated corpora:
+ * - huge:     a few sections with a very large number of keys
+ * - tiny:     many sections with one to four keys each
+ * - long:     values of a few hundred to a few thousand bytes
+ * - comments: several comment lines around every key
+ * - quoted:   quoted values with spaces, separators and comment symbols
+ * - mixed:    all of the above, with uneven spacing
+*/
+enum corpus_kind {
+    CORPUS_HUGE,
+    CORPUS_TINY,
+    CORPUS_LONG,
+    CORPUS_COMMENTS,
+    CORPUS_QUOTED,
+    CORPUS_MIXED,
+    CORPUS_KIND_COUNT
+};
+
+static const char *const corpus_names[CORPUS_KIND_COUNT] = {
+    "huge", "tiny", "long", "comments", "quoted", "mixed"
+};
+
+struct corpus {
+    char                                   *buf;
+    size_t                                  size;
+    size_t                                  capacity;
+    uint64_t                                seed;
+};
+
+static const char corpus_words[][12] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf",
+    "hotel", "india", "juliett", "kilo", "lima", "mike", "november",
+    "oscar", "papa", "quebec", "romeo", "sierra", "tango", "uniform",
+    "victor", "whiskey", "xray", "yankee", "zulu"
+};
+
+#define CORPUS_WORD_COUNT (sizeof corpus_words / sizeof corpus_words[0])
+
+/* xorshift64*, so that the same seed always gives the same corpus */
+static uint64_t corpus_random(struct corpus *c)
+{
+    c->seed ^= c->seed >> 12;
+    c->seed ^= c->seed << 25;
+    c->seed ^= c->seed >> 27;
+    return c->seed * 0x2545f4914f6cdd1dull;
+}
+
+static unsigned corpus_range(struct corpus *c, unsigned lo, unsigned hi)
+{
+    return lo + (unsigned) (corpus_random(c) % (hi - lo + 1));
+}
+
+static int corpus_reserve(struct corpus *c, size_t n)
+{
+    char *buf;
+    size_t capacity = c->capacity ? c->capacity : 4096;
+
+    if (c->size + n + 1 <= c->capacity)
+        return 1;
+
+    while (capacity < c->size + n + 1)
+        capacity *= 2;
+
+    if ((buf = (char*) realloc(c->buf, capacity)) == NULL)
+        return 0;
+
+    c->buf = buf;
+    c->capacity = capacity;
+    return 1;
+}
+
+static void corpus_put(struct corpus *c, const char *str, size_t n)
+{
+    if (corpus_reserve(c, n)) {
+        memcpy(c->buf + c->size, str, n);
+        c->size += n;
+        c->buf[c->size] = '\0';
+    }
+}
+
+static void corpus_puts(struct corpus *c, const char *str)
+{
+    corpus_put(c, str, strlen(str));
+}
+
+static const char *corpus_word(struct corpus *c)
+{
+    return corpus_words[corpus_random(c) % CORPUS_WORD_COUNT];
+}
+
+static void corpus_spaces(struct corpus *c, unsigned max)
+{
+    unsigned n = corpus_range(c, 0, max);
+
+    while (n-- > 0)
+        corpus_put(c, (corpus_random(c) & 7) ? " " : "\t", 1);
+}
+
+/* Appends a value of `min` to `max` bytes made of words */
+static void corpus_value(struct corpus *c, unsigned min, unsigned max)
+{
+    size_t start = c->size, target = corpus_range(c, min, max);
+    char number[24];
+
+    while (c->size - start < target) {
+        if (c->size > start)
+            corpus_put(c, " ", 1);
+
+        if (corpus_random(c) & 1) {
+            sprintf(number, "%u", (unsigned) (corpus_random(c) % 100000));
+            corpus_puts(c, number);
+        } else {
+            corpus_puts(c, corpus_word(c));
+        }
+    }
+}
+
+static void corpus_comment(struct corpus *c)
+{
+    corpus_puts(c, (corpus_random(c) & 1) ? "; " : "# ");
+    corpus_value(c, 20, 70);
+    corpus_put(c, "\n", 1);
+}
+
+static void corpus_section(struct corpus *c, unsigned long index)
+{
+    char name[64];
+
+    sprintf(name, "[%s.%lu]\n", corpus_word(c), index);
+    corpus_puts(c, name);
+}
+
+static void corpus_key(struct corpus *c, enum corpus_kind kind,
+                       unsigned long index)
+{
+    char key[64];
+    unsigned i;
+
+    if (kind == CORPUS_COMMENTS || (kind == CORPUS_MIXED && index % 8 == 0))
+        for (i = corpus_range(c, 1, 3); i > 0; --i)
+            corpus_comment(c);
+
+    if (kind == CORPUS_MIXED)
+        corpus_spaces(c, 2);
+
+    sprintf(key, "%s_%lu", corpus_word(c), index);
+    corpus_puts(c, key);
+
+    if (kind == CORPUS_MIXED)
+        corpus_spaces(c, 3);
+    else
+        corpus_put(c, " ", 1);
+
+    corpus_put(c, (kind == CORPUS_MIXED && (index & 1)) ? ":" : "=", 1);
+
+    if (kind == CORPUS_MIXED)
+        corpus_spaces(c, 3);
+    else
+        corpus_put(c, " ", 1);
+
+    switch (kind) {
+    case CORPUS_LONG:
+        corpus_value(c, 200, 4000);
+        break;
+
+    case CORPUS_QUOTED:
+        corpus_put(c, "\"", 1);
+        corpus_value(c, 10, 60);
+        corpus_puts(c, (index & 1) ? " ; not a = comment" : " # [x]: y");
+        corpus_put(c, "\"", 1);
+        break;
+
+    case CORPUS_MIXED:
+        if (index % 16 == 0)
+            corpus_value(c, 200, 1000);
+        else if (index % 4 == 0) {
+            corpus_put(c, "'", 1);
+            corpus_value(c, 5, 40);
+            corpus_put(c, "'", 1);
+        } else
+            corpus_value(c, 1, 30);
+
+        corpus_spaces(c, 2);
+        break;
+
+    default:
+        corpus_value(c, 1, 30);
+        break;
+    }
+
+    corpus_put(c, "\n", 1);
+}
+
+/**
+ * Generates about `size` bytes of INI text of the given `kind` and
+ * returns it as a NUL-terminated string, or NULL if out of memory. The
+ * output only depends on `kind`, `size` and `seed`.
+ *
+ * WARNING: The returned string must be freed with `free`.
+*/
+static char *corpus_generate(enum corpus_kind kind, size_t size,
+                             uint64_t seed, size_t *length)
+{
+    struct corpus c = {0};
+    unsigned long index = 0, keys_left = 0;
+    unsigned long sections = 0;
+
+    c.seed = seed ? seed : 0x9e3779b97f4a7c15ull;
+
+    if (!corpus_reserve(&c, size + 4096))
+        return NULL;
+
+    corpus_puts(&c, "; generated corpus\n");
+
+    while (c.size < size) {
+        if (keys_left == 0) {
+            if (sections > 0)
+                corpus_put(&c, "\n", 1);
+
+            corpus_section(&c, sections++);
+
+            switch (kind) {
+            case CORPUS_HUGE:
+                /* About four sections, at ~32 bytes per line */
+                keys_left = size / 4 / 32 + 1;
+                break;
+            case CORPUS_TINY:
+                keys_left = corpus_range(&c, 1, 4);
+                break;
+            default:
+                keys_left = corpus_range(&c, 8, 64);
+                break;
+            }
+        }
+
+        corpus_key(&c, kind, index++);
+        --keys_left;
+    }
+
+    if (length != NULL)
+        *length = c.size;
+
+    return c.buf;
+}
+
+/* Returns the kind named `name`, or CORPUS_KIND_COUNT if unknown */
+static enum corpus_kind corpus_kind_by_name(const char *name)
+{
+    int i;
+
+    for (i = 0; i < CORPUS_KIND_COUNT; ++i)
+        if (strcmp(corpus_names[i], name) == 0)
+            return (enum corpus_kind) i;
+
+    return CORPUS_KIND_COUNT;
+}
+
+#endif /* INI_BENCH_CORPUS_H */
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "ini.h"
+
+#define CORPUS_SIZE     (64 * 1024 * 1024)
+#define ITERATIONS      5
+
+#if defined(INI_HAS_AVX2)
+#define SCANNER "avx2"
+#elif defined(INI_HAS_SSE2)
+#define SCANNER "sse2"
+#else
+#define SCANNER "scalar"
+#endif
+
+/* Generates roughly `size` bytes of sections, comments and entries */
+static char *generate(size_t size, size_t *length)
+{
+    char *buf = (char*) malloc(size + 256);
+    size_t n = 0;
+    unsigned long i = 0;
+
+    if (buf == NULL)
+        return NULL;
+
+    while (n < size) {
+        if (i % 64 == 0)
+            n += sprintf(buf + n, "\n[section.%lu]\n", i / 64);
+
+        if (i % 16 == 0)
+            n += sprintf(buf + n, "; comment about the next key %lu\n", i);
+
+        if (i % 4 == 0)
+            n += sprintf(buf + n, "key%lu = \"quoted value %lu\"\n", i, i);
+        else
+            n += sprintf(buf + n, "  key%lu=value %lu   \n", i, i * 31);
+
+        ++i;
+    }
+
+    *length = n;
+    return buf;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Runs only the line scanner over the corpus */
+static size_t scan(const char *corpus, size_t length)
+{
+    struct ini_scanner scanner = {0};
+    struct ini_line_tokens tokens;
+    const char *p, *end = corpus + length;
+    size_t lines = 0;
+
+    ini_scanner_init(&scanner);
+
+    for (p = corpus; p < end; p = tokens.next) {
+        ini_scan_line(&scanner, p, end, &tokens);
+        lines += (tokens.separator < tokens.size);
+    }
+
+    return lines;
+}
+
+int main(void)
+{
+    size_t length, lines = 0;
+    double start, best = 0.0, best_scan = 0.0, elapsed;
+    char *corpus = generate(CORPUS_SIZE, &length);
+    ini_t ini;
+    int i;
+
+    if (corpus == NULL)
+        return 1;
+
+    for (i = 0; i < ITERATIONS; ++i) {
+        start = now();
+        lines += scan(corpus, length);
+        elapsed = now() - start;
+
+        if (best_scan == 0.0 || elapsed < best_scan)
+            best_scan = elapsed;
+    }
+
+    for (i = 0; i < ITERATIONS; ++i) {
+        start = now();
+        ini = ini_parse_from_buffer(corpus, length);
+        elapsed = now() - start;
+
+        if (best == 0.0 || elapsed < best)
+            best = elapsed;
+
+        ini_free(ini);
+    }
+
+    printf("%-8s scan %8.1f MB/s  parse %8.1f MB/s  (%zu bytes, %zu lines)\n",
+           SCANNER, length / best_scan / 1e6, length / best / 1e6, length,
+           lines / ITERATIONS);
+
+    free(corpus);
+    return 0;
+}
@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "corpus.h"
+
+/**
+ * Every allocation made by ini.h goes through `bench_allocator`, which
+ * counts the allocations and the bytes requested.
+*/
+extern const struct ini_allocator bench_allocator;
+
+#define INI_DEFAULT_ALLOCATOR               (&bench_allocator)
+
+#include "ini.h"
+
+static size_t bench_allocs, bench_alloc_bytes;
+
+static void *bench_allocate(void *user, size_t size)
+{
+    (void) user;
+    ++bench_allocs;
+    bench_alloc_bytes += size;
+    return malloc(size);
+}
+
+static void *bench_reallocate(void *user, void *ptr, size_t size)
+{
+    (void) user;
+    ++bench_allocs;
+    bench_alloc_bytes += size;
+    return realloc(ptr, size);
+}
+
+static void bench_deallocate(void *user, void *ptr)
+{
+    (void) user;
+    free(ptr);
+}
+
+const struct ini_allocator bench_allocator = {
+    bench_allocate, bench_reallocate, bench_deallocate, NULL
+};
+
+#define DEFAULT_SIZE_MB     16
+#define DEFAULT_RUNS        7
+#define BATCH               64
+#define MAX_OPS             (1 << 21)
+#define CORPUS_PATH         "corpus.tmp.ini"
+
+struct pair {
+    const char                             *section;
+    const char                             *key;
+};
+
+struct samples {
+    double                                 *time;
+    size_t                                  count;
+    size_t                                  capacity;
+    /* Operations and bytes of input or output per sample */
+    size_t                                  ops;
+    size_t                                  bytes;
+    size_t                                  allocs;
+    size_t                                  alloc_bytes;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void samples_begin(struct samples *s, size_t capacity,
+                          size_t ops, size_t bytes)
+{
+    s->time = (double*) malloc(capacity * sizeof *s->time);
+    s->count = 0;
+    s->capacity = capacity;
+    s->ops = ops;
+    s->bytes = bytes;
+    s->allocs = 0;
+    s->alloc_bytes = 0;
+}
+
+static void samples_add(struct samples *s, double time)
+{
+    if (s->count < s->capacity)
+        s->time[s->count++] = time;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+/* Formats a duration in seconds with a readable unit */
+static const char *format_time(char *buf, double time)
+{
+    if (time < 1e-6)
+        sprintf(buf, "%7.1f ns", time * 1e9);
+    else if (time < 1e-3)
+        sprintf(buf, "%7.2f us", time * 1e6);
+    else if (time < 1.0)
+        sprintf(buf, "%7.2f ms", time * 1e3);
+    else
+        sprintf(buf, "%7.3f s ", time);
+
+    return buf;
+}
+
+/**
+ * Prints the throughput at the median, the per-operation latency
+ * percentiles and the allocations per operation, then frees `s`.
+*/
+static void samples_report(struct samples *s, const char *name)
+{
+    char p50[32], p90[32], p99[32], max[32], rate[32];
+    size_t total_ops = s->count * s->ops;
+    double median;
+
+    if (s->count == 0) {
+        free(s->time);
+        return;
+    }
+
+    qsort(s->time, s->count, sizeof *s->time, compare_double);
+    median = s->time[s->count / 2];
+
+    if (s->bytes > 0)
+        sprintf(rate, "%8.1f MB/s ", s->bytes / median / 1e6);
+    else
+        sprintf(rate, "%8.2f Mop/s", s->ops / median / 1e6);
+
+    printf("  %-15s %s %s %s %s %s %10.2f %11.1f\n", name, rate,
+           format_time(p50, median / s->ops),
+           format_time(p90, s->time[s->count * 90 / 100] / s->ops),
+           format_time(p99, s->time[s->count * 99 / 100] / s->ops),
+           format_time(max, s->time[s->count - 1] / s->ops),
+           (double) s->allocs / total_ops,
+           (double) s->alloc_bytes / total_ops);
+
+    free(s->time);
+}
+
+static void print_header(void)
+{
+    printf("  %-15s %13s %10s %10s %10s %10s %10s %11s\n", "benchmark",
+           "throughput", "p50", "p90", "p99", "max", "allocs/op",
+           "bytes/op");
+}
+
+static void null_write(struct ini_io *io, const char *buf, size_t n)
+{
+    (void) buf;
+    *(size_t*) io->raw += n;
+}
+
+/* Collects every (section, key) pair of `ini` and shuffles them */
+static struct pair *collect_pairs(ini_t ini, size_t *count)
+{
+    struct ini_section_iter sections;
+    struct ini_key_iter keys;
+    struct pair *pairs, tmp;
+    size_t n = 0, i, j, capacity = 0;
+    uint64_t seed = 0x853c49e6748fea9bull;
+
+    ini_section_iter_init(&sections, ini);
+
+    while (ini_section_iter_next(&sections))
+        capacity += sections.section->size;
+
+    if ((pairs = (struct pair*) malloc((capacity + 1) * sizeof *pairs)) == NULL)
+        return NULL;
+
+    ini_section_iter_init(&sections, ini);
+
+    while (ini_section_iter_next(&sections)) {
+        ini_key_iter_init(&keys, sections.section);
+
+        while (ini_key_iter_next(&keys)) {
+            pairs[n].section = sections.name;
+            pairs[n++].key = keys.key;
+        }
+    }
+
+    for (i = n; i > 1; --i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        j = (size_t) (seed >> 33) % i;
+        tmp = pairs[i - 1];
+        pairs[i - 1] = pairs[j];
+        pairs[j] = tmp;
+    }
+
+    *count = n;
+    return pairs;
+}
+
+static void bench_parse(const char *corpus, size_t length, int runs)
+{
+    struct samples parse, path, store, destroy;
+    struct ini_io io = {0};
+    size_t written = 0;
+    double start;
+    FILE *file;
+    ini_t ini;
+    int i;
+
+    if ((file = fopen(CORPUS_PATH, "wb")) != NULL) {
+        fwrite(corpus, 1, length, file);
+        fclose(file);
+    }
+
+    io.raw = &written;
+    io.mode = INI_IO_MODE_WRITE;
+    io.write = null_write;
+
+    samples_begin(&parse, runs, 1, length);
+    samples_begin(&path, runs, 1, length);
+    samples_begin(&store, runs, 1, 0);
+    samples_begin(&destroy, 2 * runs, 1, length);
+
+    for (i = 0; i < runs; ++i) {
+        bench_allocs = bench_alloc_bytes = 0;
+        start = now();
+        ini = ini_parse_from_str(corpus);
+        samples_add(&parse, now() - start);
+        parse.allocs += bench_allocs;
+        parse.alloc_bytes += bench_alloc_bytes;
+
+        bench_allocs = bench_alloc_bytes = 0;
+        written = 0;
+        start = now();
+        ini_store(ini, &io);
+        samples_add(&store, now() - start);
+        store.bytes = written;
+        store.allocs += bench_allocs;
+        store.alloc_bytes += bench_alloc_bytes;
+
+        start = now();
+        ini_free(ini);
+        samples_add(&destroy, now() - start);
+
+        bench_allocs = bench_alloc_bytes = 0;
+        start = now();
+        ini = ini_parse_from_path(CORPUS_PATH);
+        samples_add(&path, now() - start);
+        path.allocs += bench_allocs;
+        path.alloc_bytes += bench_alloc_bytes;
+
+        start = now();
+        ini_free(ini);
+        samples_add(&destroy, now() - start);
+    }
+
+    remove(CORPUS_PATH);
+
+    samples_report(&parse, "parse_from_str");
+    samples_report(&path, "parse_from_path");
+    samples_report(&store, "store");
+    samples_report(&destroy, "free");
+}
+
+static void bench_access(const char *corpus)
+{
+    struct samples hit, miss, overwrite, insert;
+    struct pair *pairs;
+    size_t count, ops, i, j;
+    char **missing;
+    volatile size_t sink = 0;
+    const char *value;
+    double start;
+    ini_t ini, fresh;
+
+    ini = ini_parse_from_str(corpus);
+
+    if (ini == NULL || (pairs = collect_pairs(ini, &count)) == NULL)
+        return;
+
+    count -= count % BATCH;
+    ops = count < MAX_OPS ? count : MAX_OPS;
+
+    if (count == 0) {
+        free(pairs);
+        ini_free(ini);
+        return;
+    }
+
+    /* Existing sections, keys that are not there */
+    missing = (char**) malloc(ops * sizeof *missing);
+
+    for (i = 0; i < ops; ++i) {
+        missing[i] = (char*) malloc(strlen(pairs[i].key) + 2);
+        sprintf(missing[i], "%s~", pairs[i].key);
+    }
+
+    samples_begin(&hit, ops / BATCH, BATCH, 0);
+    samples_begin(&miss, ops / BATCH, BATCH, 0);
+    samples_begin(&overwrite, ops / BATCH, BATCH, 0);
+    samples_begin(&insert, count / BATCH, BATCH, 0);
+
+    bench_allocs = bench_alloc_bytes = 0;
+
+    for (i = 0; i < ops; i += BATCH) {
+        start = now();
+
+        for (j = i; j < i + BATCH; ++j) {
+            value = ini_get(ini, pairs[j].section, pairs[j].key, NULL);
+            sink += (value != NULL);
+        }
+
+        samples_add(&hit, now() - start);
+    }
+
+    hit.allocs = bench_allocs;
+    hit.alloc_bytes = bench_alloc_bytes;
+    bench_allocs = bench_alloc_bytes = 0;
+
+    for (i = 0; i < ops; i += BATCH) {
+        start = now();
+
+        for (j = i; j < i + BATCH; ++j) {
+            value = ini_get(ini, pairs[j].section, missing[j], NULL);
+            sink += (value != NULL);
+        }
+
+        samples_add(&miss, now() - start);
+    }
+
+    miss.allocs = bench_allocs;
+    miss.alloc_bytes = bench_alloc_bytes;
+    bench_allocs = bench_alloc_bytes = 0;
+
+    for (i = 0; i < ops; i += BATCH) {
+        start = now();
+
+        for (j = i; j < i + BATCH; ++j)
+            ini_set(ini, pairs[j].section, pairs[j].key, "updated value");
+
+        samples_add(&overwrite, now() - start);
+    }
+
+    overwrite.allocs = bench_allocs;
+    overwrite.alloc_bytes = bench_alloc_bytes;
+    bench_allocs = bench_alloc_bytes = 0;
+
+    fresh = ini_new();
+
+    for (i = 0; i < count; i += BATCH) {
+        start = now();
+
+        for (j = i; j < i + BATCH; ++j)
+            ini_set(fresh, pairs[j].section, pairs[j].key, "value");
+
+        samples_add(&insert, now() - start);
+    }
+
+    insert.allocs = bench_allocs;
+    insert.alloc_bytes = bench_alloc_bytes;
+
+    samples_report(&hit, "get_hit");
+    samples_report(&miss, "get_miss");
+    samples_report(&overwrite, "set_overwrite");
+    samples_report(&insert, "set_insert");
+
+    if (sink != ops)
+        fprintf(stderr, "unexpected lookup results: %zu\n", (size_t) sink);
+
+    for (i = 0; i < ops; ++i)
+        free(missing[i]);
+
+    free(missing);
+    free(pairs);
+    ini_free(fresh);
+    ini_free(ini);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-k kind] [-s megabytes] [-r runs]\n"
+                    "kinds: huge tiny long comments quoted mixed\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    enum corpus_kind kind, only = CORPUS_KIND_COUNT;
+    double size_mb = DEFAULT_SIZE_MB;
+    int i, runs = DEFAULT_RUNS;
+    size_t length;
+    char *corpus;
+
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            only = corpus_kind_by_name(argv[++i]);
+
+            if (only == CORPUS_KIND_COUNT) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            size_mb = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (runs < 1)
+        runs = 1;
+
+    for (i = 0; i < CORPUS_KIND_COUNT; ++i) {
+        kind = (enum corpus_kind) i;
+
+        if (only != CORPUS_KIND_COUNT && kind != only)
+            continue;
+
+        corpus = corpus_generate(kind, (size_t) (size_mb * 1024 * 1024),
+                                 0, &length);
+
+        if (corpus == NULL)
+            return 1;
+
+        printf("%s: %zu bytes, %d runs\n", corpus_names[kind], length, runs);
+        print_header();
+        bench_parse(corpus, length, runs);
+        bench_access(corpus);
+        printf("\n");
+
+        free(corpus);
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <stdio.h>
+
+#include "ini.h"
+
+static const char *example =
+    "build folder = \"build/\"		\n"
+    "\n"
+    "   [game_info]\n"
+    "name=    my first game\n"
+    "year	= 1997\n"
+    "   version=1.0    ";
+
+struct game_info {
+    char name[32];
+    int year;
+    double version;
+    bool multiplayer;
+};
+
+static const struct ini_field game_info_fields[] = {
+    INI_FIELD(struct game_info, name, STRING, "game_info", "name", "noname"),
+    INI_FIELD(struct game_info, year, INT, "game_info", "year", "0"),
+    INI_FIELD(struct game_info, version, DOUBLE, "game_info", "version", "0"),
+    INI_FIELD(struct game_info, multiplayer, BOOL, "game_info",
+              "multiplayer", "no")
+};
+
+int main(void)
+{
+    struct ini_schema schema;
+    struct game_info info;
+    enum ini_status status;
+
+    if (!ini_schema_init(&schema, game_info_fields,
+                         sizeof game_info_fields / sizeof *game_info_fields))
+    {
+        return 1;
+    }
+
+    status = ini_bind_buffer(&schema, example, strlen(example), &info);
+
+    puts("----------------------------------");
+    printf("     status:\t%d\n", (int) status);
+    printf("       name:\t%s\n", info.name);
+    printf("       year:\t%d\n", info.year);
+    printf("    version:\t%.1f\n", info.version);
+    printf("multiplayer:\t%s\n", info.multiplayer ? "yes" : "no");
+    puts("----------------------------------");
+
+    ini_schema_free(&schema);
+    return 0;
+}
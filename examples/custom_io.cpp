@@ -3,11 +3,11 @@
 
 #include "ini.h"
 
-static void ini_io_ostream_putc(ini_io *io, int ch)
+static void ini_io_ostream_write(ini_io *io, const char *buf, size_t n)
 {
     if (io != nullptr) {
-        char cch = static_cast<char>(ch);
-        *(reinterpret_cast<std::ostream*>(io->raw)) << cch;
+        std::streamsize size = static_cast<std::streamsize>(n);
+        reinterpret_cast<std::ostream*>(io->raw)->write(buf, size);
     }
 }
 
@@ -15,9 +15,9 @@ static void ini_store_to_stream(ini_t ini, std::ostream &stream)
 {
     ini_io io {0};
 
-    io.raw = reinterpret_cast<void*>(&std::cout);
+    io.raw = reinterpret_cast<void*>(&stream);
     io.mode = INI_IO_MODE_WRITE;
-    io.putc = ini_io_ostream_putc;
+    io.write = ini_io_ostream_write;
 
     ini_store(ini, &io);
 }
@@ -0,0 +1,29 @@
+#include <iostream>
+#include <string>
+
+#include "ini.hpp"
+
+int main()
+{
+    constexpr ini::name server("server");
+
+    auto doc = ini::document::parse("[server]\n"
+                                    "host = localhost\n"
+                                    "port = 8080\n"
+                                    "buffer = 64k\n");
+
+    if (!doc)
+        return 1;
+
+    int port = doc.get_or(server, INI_NAME("port"), 80);
+    auto buffer = doc.get<ini::bytes>(server, INI_NAME("buffer"));
+    std::string host(doc.get(server, "host").value_or("0.0.0.0"));
+
+    std::cout << host << ':' << port << " (" << buffer->value
+              << " bytes)" << std::endl;
+
+    doc.set("server", "port", port + 1);
+    doc.set("server", "tls", true);
+    std::cout << doc;
+    return 0;
+}
@@ -8,29 +8,183 @@
 #define INI_H_INCLUDED
 
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+
+#if !defined(INI_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define INI_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if !defined(INI_NO_SIMD) && defined(__GNUC__) && defined(__AVX2__)
+#define INI_HAS_AVX2
+#include <immintrin.h>
+#elif !defined(INI_NO_SIMD) && defined(__GNUC__) && defined(__SSE2__)
+#define INI_HAS_SSE2
+#include <emmintrin.h>
+#endif
 
 #define INI_MAP_START_CAPACITY              16
 #define INI_MAP_LOAD_FACTOR                 0.75
+/* Values shorter than this are stored inside `ini_map_entry` */
+#define INI_ENTRY_INLINE_SIZE               18
+#if !defined(INI_NO_THREADS) && defined(__GNUC__)
+#define INI_HAS_ATOMICS
+#endif
+
+#if !defined(INI_NO_THREADS) && (defined(__unix__) || defined(__APPLE__))
+#define INI_HAS_PTHREADS
+#include <pthread.h>
+#endif
+
+#if !defined(INI_NO_INOTIFY) && defined(INI_HAS_MMAP) && defined(__linux__)
+#define INI_HAS_INOTIFY
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
 #define INI_DEFAULT_SECTION_NAME            "DEFAULT"
 #define INI_COMMENT_SYMBOLS                 ";#"
 #define INI_KEY_VALUE_SEPARATORS            "=:"
+#define INI_ARENA_BLOCK_SIZE                65536
+#define INI_ARENA_ALIGNMENT                 (2 * sizeof(void*))
+#define INI_IO_BUFFER_SIZE                  65536
+#define INI_FROZEN_MAGIC                    0x46494e49 /* "INIF" */
+#define INI_FROZEN_VERSION                  1
+#define INI_FROZEN_BUCKET_SIZE              4
+#define INI_FROZEN_MAX_DISPLACEMENT         (1u << 20)
+#define INI_FROZEN_NONE                     UINT32_MAX
+#define INI_FROZEN_MAPPED                   0x1
+#define INI_CACHE_LINE_SIZE                 64
+#define INI_FIELD_BUFFER_SIZE               128
+#define INI_OVERLAY_CACHE_SIZE              64
+#define INI_OVERLAY_MAX_DEPTH               8
+#define INI_INCLUDE_SECTION_NAME            "include"
+
+#define INI_PARALLEL_MIN_CHUNK              (1 << 20)
+#define INI_PARALLEL_MAX_THREADS            64
+
+#ifndef INI_SHARED_MAX_READERS
+#define INI_SHARED_MAX_READERS              64
+#endif /* INI_SHARED_MAX_READERS */
+
+#ifndef INI_HASH_SEED
+#define INI_HASH_SEED                       0
+#endif /* INI_HASH_SEED */
+
+/**
+ * Define INI_ENABLE_STATS to count rehashes and parsed lines, bytes and
+ * time for `ini_stats`. Without it the counters and `INI_ON_PARSE`
+ * compile to nothing.
+*/
+#ifdef INI_ENABLE_STATS
+#include <time.h>
+#define INI_STATS(expr)                     (expr)
+#else
+#define INI_STATS(expr)                     ((void) 0)
+#endif /* INI_ENABLE_STATS */
+
+/* Called after a table of `map` grows to `capacity` slots */
+#ifndef INI_ON_REHASH
+#define INI_ON_REHASH(map, capacity)        ((void) 0)
+#endif /* INI_ON_REHASH */
+
+/* Called after each parse with INI_ENABLE_STATS, time in seconds */
+#ifndef INI_ON_PARSE
+#define INI_ON_PARSE(ini, lines, bytes, time) ((void) 0)
+#endif /* INI_ON_PARSE */
 
 #define ini_strdup(str)                                                     \
     ((str) ? ini_strndup(str, strlen(str)) : NULL)
 
+#define ini_isspace(ch)                                                     \
+    ((ch) == ' ' || ((ch) >= '\t' && (ch) <= '\r'))
+
 #define ini_map_index(hash, capacity)                                       \
     ((hash) & (capacity - 1))
 
+#define ini_map_distance(hash, index, capacity)                             \
+    (((index) - ini_map_index(hash, capacity)) & (capacity - 1))
+
 #define ini_map_keys_equal(hash1, key1, hash2, key2)                        \
     ((hash1 == hash2) && (strcmp(key1, key2) == 0))
 
-#ifdef _cplusplus
+
+#ifdef __cplusplus
 extern "C" {
-#endif /* _cplusplus */
+#endif /* __cplusplus */
+
+/**
+ * Result of the typed accessors, such as `ini_get_int`.
+*/
+enum ini_status {
+    INI_OK,
+    INI_ERROR_MISSING, /* The key does not exist or has no value */
+    INI_ERROR_INVALID, /* The value is not of the requested type */
+    INI_ERROR_RANGE    /* The value doesn't fit into the type */
+};
+
+/**
+ * Types of the values cached by the typed accessors.
+*/
+enum ini_type {
+    INI_TYPE_NONE,
+    INI_TYPE_INT,
+    INI_TYPE_DOUBLE,
+    INI_TYPE_BOOL,
+    INI_TYPE_SIZE,
+    /* The entry is being cached by another thread */
+    INI_TYPE_BUSY
+};
+
+/**
+ * Value converted by a typed accessor.
+*/
+union ini_number {
+    long long                               i;
+    double                                  d;
+    bool                                    b;
+    size_t                                  size;
+};
+
+/**
+ * Kinds of changes reported by `ini_diff`.
+*/
+enum ini_change {
+    INI_CHANGE_ADDED,
+    INI_CHANGE_REMOVED,
+    INI_CHANGE_CHANGED
+};
+
+/**
+ * Function called by `ini_diff` for every change. `key` is NULL for
+ * sections without keys, and `old_value` or `new_value` is NULL if
+ * there is no such value.
+*/
+typedef void (*ini_diff_callback)(enum ini_change change, const char *section,
+                                  const char *key, const char *old_value,
+                                  const char *new_value, void *user);
+
+/**
+ * Functions called by `ini_parse_cb` for every section line, key-value
+ * line and comment. The spans are only valid during the call and don't
+ * end with `\0`. Returning false stops the parsing.
+*/
+typedef bool (*ini_section_callback)(const char *name, size_t size,
+                                     void *user);
+typedef bool (*ini_kv_callback)(const char *key, size_t key_size,
+                                const char *value, size_t value_size,
+                                void *user);
+typedef bool (*ini_comment_callback)(const char *text, size_t size,
+                                     void *user);
 
 enum ini_io_mode {
     INI_IO_MODE_READ, /* READ ONLY */
@@ -53,31 +207,312 @@ enum ini_io_mode {
 */
 typedef struct ini_map                     *ini_t;
 
+/**
+ * Pre-resolved (section, key) pair of an `ini_t`, see `ini_lookup`.
+ * It points straight at the entry of the key, so reading through it
+ * neither hashes nor compares strings.
+*/
+typedef const struct ini_map_entry         *ini_handle_t;
+
 /**
  * The `ini_map_free_value` type is used to pass a function to free
  * memory for values stored in the `ini_map` structure.
 */
-typedef void (*ini_map_free_value)(void *ptr);
+typedef void (*ini_map_free_value)(struct ini_map *map, void *ptr);
+
+/**
+ * Memory allocator of the library. `user` is passed to every function.
+ * 
+ * An `ini_t` created by `ini_new_with` or `ini_new_arena_with` keeps
+ * all of its memory, and the buffers of parsing and storing it, in its
+ * own allocator. Everything else uses `INI_DEFAULT_ALLOCATOR`, which
+ * can be defined before including `ini.h` as the address of another
+ * `struct ini_allocator` declared `extern`. By default it calls
+ * malloc, realloc and free.
+*/
+struct ini_allocator {
+    void *(*allocate)(void *user, size_t size);
+    void *(*reallocate)(void *user, void *ptr, size_t size);
+    /* `ptr` is never NULL */
+    void (*deallocate)(void *user, void *ptr);
+    void                                   *user;
+};
+
+/**
+ * Immutable snapshot of an `ini_t`, see `ini_freeze`.
+*/
+typedef const struct ini_frozen           *ini_frozen_t;
+
+/**
+ * One block of memory owned by `ini_arena`. The data follows the
+ * header directly.
+*/
+struct ini_arena_block {
+    struct ini_arena_block                 *next;
+    size_t                                  size;
+    size_t                                  used;
+};
+
+/**
+ * Bump allocator used by arena-backed `ini_t` objects. Entries, keys,
+ * values and section maps are carved out of a few large blocks, which
+ * are released all at once.
+ * 
+ * WARNING: Don't forget to free memory with `ini_arena_free`
+*/
+struct ini_arena {
+    struct ini_arena_block                 *head;
+    size_t                                  block_size;
+    /* Allocator of the blocks, NULL for INI_DEFAULT_ALLOCATOR */
+    const struct ini_allocator             *allocator;
+};
 
+/**
+ * Key-value pair of `ini_map`, 64 bytes on 64-bit targets. A copied key
+ * follows the entry directly, and a short string value is kept in
+ * `inline_value`, so a lookup that hits only reads the entry and the
+ * bytes right after it.
+*/
 struct ini_map_entry {
-    unsigned int                            hash;
+    uint64_t                                hash;
     char                                   *key;
+    /* Points to `inline_value` for short string values */
     void                                   *value;
+    /* Next entry in insertion order */
     struct ini_map_entry                   *next;
+    /* Last conversion of `value` made by a typed accessor */
+    union ini_number                        cached;
+    /* Length of `key` */
+    uint32_t                                size;
+    /* Type of `cached`, INI_TYPE_NONE if nothing is cached */
+    unsigned char                           cached_type;
+    /* Status of the conversion, see `enum ini_status` */
+    unsigned char                           cached_status;
+    char                                    inline_value[INI_ENTRY_INLINE_SIZE];
+};
+
+/**
+ * Slot of the `ini_map` table. The full hash is kept next to the entry
+ * pointer, so probing doesn't touch the entries of other keys.
+*/
+struct ini_map_slot {
+    uint64_t                                hash;
+    /* NULL if the slot is empty */
+    struct ini_map_entry                   *entry;
+};
+
+/**
+ * Internal node of the crit-bit tree of the section names of an
+ * `ini_t`, see `ini_sections_with_prefix`. It tells its children apart
+ * by one bit of the byte `byte` of the names, which is the only bit
+ * clear in `otherbits`. A child is a section entry, or another node
+ * tagged with 1 in the lowest bit.
+*/
+struct ini_crit_node {
+    void                                   *child[2];
+    size_t                                  byte;
+    unsigned char                           otherbits;
+};
+
+#ifdef INI_ENABLE_STATS
+/**
+ * Counters of a map that are kept with INI_ENABLE_STATS.
+*/
+struct ini_map_counters {
+    /* Number of times the table has grown */
+    size_t                                  rehashes;
+    /* Lines and bytes parsed into the map, and the time it took */
+    size_t                                  lines;
+    size_t                                  bytes;
+    double                                  parse_time;
 };
+#endif /* INI_ENABLE_STATS */
 
 /**
  * Hash table that stores all key-value pairs.
  * 
  * WARNING: Don't forget to free memory with `ini_map_free`
  * 
- * Based on implementation `libcutils/hashmap.c`
- */
+ * It is an open addressing table with Robin Hood linear probing over
+ * contiguous slots: on insertion an element takes the slot of any
+ * element that is closer to its home slot, which keeps probe sequences
+ * short and lets lookups of missing keys stop early. Entries are linked
+ * in insertion order and never move once they are created.
+*/
 struct ini_map {
-    struct ini_map_entry                  **values;
+    /* `capacity` slots */
+    struct ini_map_slot                    *slots;
     ini_map_free_value                      free;
+    /* Memory owner of the map, or NULL if it lives on the heap */
+    struct ini_arena                       *arena;
+    /* Allocator of the map, NULL for INI_DEFAULT_ALLOCATOR */
+    const struct ini_allocator             *allocator;
+    size_t                                  capacity;
+    size_t                                  size;
+    struct ini_map_entry                   *first;
+    struct ini_map_entry                   *last;
+    /* Hash of all keys and values, see `ini_map_digest` */
+    uint64_t                                digest;
+    bool                                    digest_valid;
+    /* Root of the crit-bit tree of the sections of an `ini_t`, if built */
+    void                                   *index;
+    /**
+     * Node that a section brings into that tree, so the tree never
+     * allocates, and the neighbours of the section in sorted order.
+    */
+    struct ini_crit_node                    node;
+    struct ini_map_entry                   *sorted_prev;
+    struct ini_map_entry                   *sorted_next;
+#ifdef INI_ENABLE_STATS
+    struct ini_map_counters                 counters;
+#endif /* INI_ENABLE_STATS */
+};
+
+/**
+ * Shape of one hash table, see `ini_stats`. A chain is the run of
+ * slots that a lookup of a key probes, from its home slot to the key.
+*/
+struct ini_map_stats {
+    size_t                                  size;
     size_t                                  capacity;
+    double                                  load_factor;
+    size_t                                  longest_chain;
+    double                                  average_chain;
+    /* Always 0 without INI_ENABLE_STATS */
+    size_t                                  rehashes;
+};
+
+/**
+ * Statistics of an `ini_t` returned by `ini_stats`.
+*/
+struct ini_stats {
+    /* Table of the sections */
+    struct ini_map_stats                    sections;
+    /**
+     * Tables of the keys of all sections taken together: sizes,
+     * capacities and rehashes are summed up, chains are of all keys
+    */
+    struct ini_map_stats                    keys;
+    /* Section with the longest chain of keys */
+    const char                             *longest_chain_section;
+    /* Bytes used for entries, slot arrays, keys and values */
+    size_t                                  entry_bytes;
+    size_t                                  slot_bytes;
+    size_t                                  key_bytes;
+    size_t                                  value_bytes;
+    /* Always 0 without INI_ENABLE_STATS */
+    size_t                                  lines;
+    size_t                                  bytes;
+    double                                  parse_time;
+};
+
+/**
+ * Cursor over the sections of an `ini_t` in insertion order, which
+ * needs no memory besides itself, see `ini_section_iter_init`.
+*/
+struct ini_section_iter {
+    /* Current section, valid after `ini_section_iter_next` */
+    const char                             *name;
+    size_t                                  size;
+    struct ini_map                         *section;
+    /* Internal: the current and the next entry */
+    struct ini_map_entry                   *entry;
+    struct ini_map_entry                   *next;
+};
+
+/**
+ * Cursor over the keys of a section in insertion order, see
+ * `ini_key_iter_init`.
+*/
+struct ini_key_iter {
+    /* Current key, valid after `ini_key_iter_next` */
+    const char                             *key;
     size_t                                  size;
+    /* NULL if the key has no value */
+    const char                             *value;
+    /* Internal: the current and the next entry */
+    struct ini_map_entry                   *entry;
+    struct ini_map_entry                   *next;
+};
+
+/**
+ * Cursor over the sections of an `ini_t` in the byte order of their
+ * names, see `ini_sections_with_prefix` and `ini_sections_in_range`.
+*/
+struct ini_sorted_iter {
+    /* Current section, valid after `ini_sorted_iter_next` */
+    const char                             *name;
+    size_t                                  size;
+    struct ini_map                         *section;
+    /* Internal: the current, the next and the first excluded entry */
+    struct ini_map_entry                   *entry;
+    struct ini_map_entry                   *next;
+    struct ini_map_entry                   *stop;
+};
+
+/**
+ * Header of a frozen snapshot. The snapshot is a single block that
+ * starts with this header, followed by the tables and the strings it
+ * refers to by offsets from the start of the block, so it can be
+ * copied or mapped anywhere as is.
+*/
+struct ini_frozen {
+    /* INI_FROZEN_MAGIC */
+    uint32_t                                magic;
+    /* INI_FROZEN_VERSION */
+    uint32_t                                version;
+    /* Size of the whole snapshot in bytes */
+    uint64_t                                size;
+    /* INI_HASH_SEED the snapshot was built with */
+    uint64_t                                seed;
+    uint32_t                                section_count;
+    uint32_t                                key_count;
+    uint32_t                                bucket_count;
+    uint32_t                                slot_count;
+    /* Offset of `slot_count` keys, see `ini_frozen_key` */
+    uint32_t                                slots;
+    /* Offset of `section_count` sections, see `ini_frozen_section` */
+    uint32_t                                sections;
+    /* Offset of `bucket_count` displacements */
+    uint32_t                                buckets;
+    /* Offset of `key_count` slot numbers in insertion order */
+    uint32_t                                order;
+    /* Offset of the strings, each of which ends with `\0` */
+    uint32_t                                strings;
+    /* INI_FROZEN_MAPPED if the snapshot is mapped from a file */
+    uint32_t                                flags;
+    /* Hash of the snapshot, with `checksum` and `flags` taken as 0 */
+    uint64_t                                checksum;
+    /* Modification time (ns) and size of the source file of the cache */
+    int64_t                                 source_mtime;
+    uint64_t                                source_size;
+};
+
+/**
+ * Section of a frozen snapshot. Its keys are the `count` slot numbers
+ * from `first` in the order table.
+*/
+struct ini_frozen_section {
+    uint32_t                                name;
+    uint32_t                                size;
+    uint32_t                                first;
+    uint32_t                                count;
+};
+
+/**
+ * Key of a frozen snapshot, which is 32 bytes, so that two of them
+ * share a cache line. `section` is INI_FROZEN_NONE in empty slots.
+*/
+struct ini_frozen_key {
+    /* Hash of the key seeded with the hash of its section */
+    uint64_t                                hash;
+    uint32_t                                section;
+    uint32_t                                key;
+    uint32_t                                key_size;
+    /* INI_FROZEN_NONE if the key has no value */
+    uint32_t                                value;
+    uint32_t                                value_size;
+    uint32_t                                reserved;
 };
 
 /**
@@ -97,6 +532,176 @@ struct ini_io {
     void (*putc)(struct ini_io*, int);
     /* Pointer to a function that checks `raw` for the end-of-file */
     bool (*eof)(struct ini_io*);
+    /**
+     * Pointer to a function to read up to `n` bytes from `raw` into
+     * `buf`. Returns the number of bytes read, 0 at the end-of-file.
+     * If NULL, `getc` and `eof` are used instead.
+    */
+    size_t (*read)(struct ini_io*, char *buf, size_t n);
+    /**
+     * Pointer to a function to write `n` bytes from `buf` to `raw`.
+     * If NULL, `putc` is used instead.
+    */
+    void (*write)(struct ini_io*, const char *buf, size_t n);
+};
+
+/**
+ * Output buffer of `ini_store`, which collects small pieces of the
+ * output and passes them to `io` in large blocks. Without `io`, it
+ * fills a fixed buffer of `capacity` bytes.
+*/
+struct ini_writer {
+    struct ini_io                          *io;
+    const struct ini_allocator             *allocator;
+    char                                   *buffer;
+    size_t                                  size;
+    size_t                                  capacity;
+};
+
+/**
+ * Line reader on top of `ini_io`, which reads the stream in blocks of
+ * `INI_IO_BUFFER_SIZE` bytes and splits them into lines in place.
+*/
+struct ini_line_reader {
+    struct ini_io                          *io;
+    const struct ini_allocator             *allocator;
+    char                                   *buffer;
+    size_t                                  capacity;
+    /* Unconsumed data is `buffer[pos..size)` */
+    size_t                                  pos;
+    size_t                                  size;
+    bool                                    eof;
+};
+
+/**
+ * Classes of the characters that the line scanner stops at.
+*/
+enum ini_char_class {
+    INI_CHAR_PLAIN = 0,
+    INI_CHAR_NEWLINE,
+    INI_CHAR_COMMENT,
+    INI_CHAR_SEPARATOR,
+    INI_CHAR_SECTION_END
+};
+
+/**
+ * State of the line scanner: the character class table, built from
+ * `INI_COMMENT_SYMBOLS` and `INI_KEY_VALUE_SEPARATORS`, and the last
+ * classified block of the input, which is reused by the next line.
+*/
+struct ini_scanner {
+    unsigned char                           classes[256];
+    bool                                    ready;
+    const char                             *block;
+    uint32_t                                mask;
+#ifdef INI_ENABLE_STATS
+    size_t                                  lines;
+    size_t                                  bytes;
+#endif /* INI_ENABLE_STATS */
+};
+
+/**
+ * Token spans of one line found by `ini_scan_line`. Positions are
+ * relative to `line`.
+*/
+struct ini_line_tokens {
+    const char                             *line;
+    /* Length of the line up to the comment or the line break */
+    size_t                                  size;
+    /* Position of the first separator, or `size` */
+    size_t                                  separator;
+    /* Position of the first `]`, or `size` */
+    size_t                                  section_end;
+    /* Beginning of the next line */
+    const char                             *next;
+};
+
+/**
+ * Callbacks of the event parser, see `ini_parse_cb`. Any of them may be
+ * NULL.
+*/
+struct ini_handler {
+    ini_section_callback                    on_section;
+    ini_kv_callback                         on_kv;
+    ini_comment_callback                    on_comment;
+    void                                   *user;
+};
+
+/**
+ * Types of the struct fields filled by `ini_bind_buffer`:
+ * - INT:    signed integer of 1, 2, 4 or 8 bytes, see `ini_get_int`
+ * - UINT:   unsigned integer of 1, 2, 4 or 8 bytes
+ * - DOUBLE: `float` or `double`
+ * - BOOL:   `bool`, see `ini_get_bool`
+ * - SIZE:   unsigned integer with a size suffix, see `ini_get_size`
+ * - STRING: `char` array, which gets a copy of the value and `\0`
+*/
+enum ini_field_type {
+    INI_FIELD_INT,
+    INI_FIELD_UINT,
+    INI_FIELD_DOUBLE,
+    INI_FIELD_BOOL,
+    INI_FIELD_SIZE,
+    INI_FIELD_STRING
+};
+
+/**
+ * Key bound to a member of a struct, see `INI_FIELD`.
+*/
+struct ini_field {
+    /* NULL for the DEFAULT section */
+    const char                             *section;
+    const char                             *key;
+    enum ini_field_type                     type;
+    size_t                                  offset;
+    size_t                                  size;
+    /* Text converted when the key is missing, or NULL to keep the member */
+    const char                             *def;
+};
+
+/**
+ * Describes the `member` of `struct_type` bound to `key` in `section`,
+ * for example:
+ * 
+ *     static const struct ini_field fields[] = {
+ *         INI_FIELD(struct server, port, INT, "server", "port", "80"),
+ *         INI_FIELD(struct server, host, STRING, "server", "host", NULL)
+ *     };
+*/
+#define INI_FIELD(struct_type, member, type, section, key, def)             \
+    { section, key, INI_FIELD_##type, offsetof(struct_type, member),        \
+      sizeof(((struct_type*) 0)->member), def }
+
+/**
+ * Table of fields prepared by `ini_schema_init`. Every field is placed
+ * with a perfect hash of its section and key, so a key of the input
+ * is matched with one hash and one string comparison.
+*/
+struct ini_schema {
+    const struct ini_field                 *fields;
+    uint32_t                                count;
+    uint32_t                                bucket_count;
+    uint32_t                                slot_count;
+    /* Displacement of every bucket */
+    uint32_t                               *buckets;
+    /* Field of every slot, or INI_FROZEN_NONE */
+    uint32_t                               *slots;
+    /* Hash of the section and of the section and key of every field */
+    uint64_t                               *section_hashes;
+    uint64_t                               *hashes;
+};
+
+/**
+ * State of `ini_bind_buffer` while it scans the input.
+*/
+struct ini_bind_state {
+    const struct ini_schema                *schema;
+    char                                   *out;
+    /* Hash and name of the current section, NULL if it isn't bound */
+    uint64_t                                section_hash;
+    const char                             *section;
+    /* First error of a conversion */
+    enum ini_status                         status;
 };
 
 /**
@@ -105,8 +710,218 @@ struct ini_io {
 struct ini_parse_state {
     struct ini_map                         *cur_section;
     ini_t                                   ini;
+    /**
+     * End of the writable input buffer when parsing in place, or NULL.
+     * Keys and values are then terminated inside the input buffer and
+     * referenced instead of copied (arena-backed `ini` only).
+    */
+    const char                             *inplace_end;
+    struct ini_scanner                      scanner;
+#ifdef INI_ENABLE_STATS
+    /* Scanner counters and clock when the current parse started */
+    struct ini_map_counters                 started;
+#endif /* INI_ENABLE_STATS */
+};
+
+/**
+ * Part of the input parsed by one thread of `ini_parse_parallel`.
+*/
+struct ini_parse_job {
+    const char                             *buf;
+    size_t                                  size;
+    ini_t                                   ini;
+};
+
+#ifdef INI_HAS_ATOMICS
+/**
+ * Reader slot of `ini_shared`, which takes a whole cache line, so that
+ * readers don't slow each other down.
+*/
+struct ini_shared_reader {
+    /* Epoch at which the reader entered, or 0 if it isn't reading */
+    uint64_t                                epoch;
+    /* Whether the slot is taken by a reader */
+    int                                     used;
+    char                                    padding[INI_CACHE_LINE_SIZE
+                                                    - sizeof(uint64_t)
+                                                    - sizeof(int)];
+};
+
+/**
+ * Replaced `ini_t` waiting until no reader can be using it.
+*/
+struct ini_shared_retired {
+    struct ini_shared_retired              *next;
+    ini_t                                   ini;
+    /* Epoch at which the `ini` was replaced */
+    uint64_t                                epoch;
+};
+
+/**
+ * Reloadable `ini_t` shared between threads, see `ini_shared_new`.
+ * 
+ * Readers announce the current epoch in their slot before loading the
+ * current `ini_t`, and clear it when they are done. A reload publishes
+ * the new `ini_t` with an atomic swap and then advances the epoch, so
+ * the old one is freed once every reader has either left or entered
+ * at a later epoch. Readers never block and never take locks.
+*/
+struct ini_shared {
+    struct ini_shared_reader                readers[INI_SHARED_MAX_READERS];
+    ini_t                                   current;
+    uint64_t                                epoch;
+    /* Taken by reloads, which never wait for readers */
+    int                                     lock;
+    struct ini_shared_retired              *retired;
+    char                                   *path;
+};
+
+typedef struct ini_shared                  *ini_shared_t;
+#endif /* INI_HAS_ATOMICS */
+
+#ifdef INI_HAS_INOTIFY
+struct ini_watcher_callback {
+    ini_diff_callback                       callback;
+    void                                   *user;
+};
+
+/**
+ * Watches an INI file with inotify and reports what changed in it,
+ * see `ini_watcher_new`.
+*/
+struct ini_watcher {
+    /* inotify descriptor */
+    int                                     fd;
+    char                                   *path;
+    /* Name of the file in its directory, points into `path` */
+    const char                             *name;
+    /* Contents of the file as of the last change */
+    ini_t                                   ini;
+    struct ini_watcher_callback            *callbacks;
+    size_t                                  callback_count;
+};
+
+typedef struct ini_watcher                 *ini_watcher_t;
+#endif /* INI_HAS_INOTIFY */
+
+/**
+ * Key resolved by an overlay: the entries of its section and of the key
+ * itself in the highest layer that has it.
+*/
+struct ini_overlay_slot {
+    /* Names as passed to `ini_overlay_lookup`, compared by address */
+    const char                             *section_name;
+    const char                             *key_name;
+    const struct ini_map_entry             *section;
+    const struct ini_map_entry             *entry;
+};
+
+/**
+ * Stack of `ini_t` layers read as one, see `ini_overlay_new`. A key is
+ * taken from the highest layer that has it, and the last keys resolved
+ * are kept in a small direct-mapped cache.
+*/
+/**
+ * Layer of an `ini_overlay`.
+*/
+struct ini_overlay_layer {
+    ini_t                                   ini;
+    /* `[include]` section of a file loaded by `ini_overlay_load`, which
+       is left out of lookups, NULL for other layers */
+    const struct ini_map                   *includes;
+};
+
+struct ini_overlay {
+    /* `count` layers, from the lowest to the highest */
+    struct ini_overlay_layer               *layers;
+    size_t                                  count;
+    size_t                                  capacity;
+    struct ini_overlay_slot                 cache[INI_OVERLAY_CACHE_SIZE];
+};
+
+typedef struct ini_overlay                 *ini_overlay_t;
+
+#ifndef INI_DEFAULT_ALLOCATOR
+static void *ini_stdlib_allocate(void *user, size_t size)
+{
+    (void) user;
+    return malloc(size);
+}
+
+static void *ini_stdlib_reallocate(void *user, void *ptr, size_t size)
+{
+    (void) user;
+    return realloc(ptr, size);
+}
+
+static void ini_stdlib_deallocate(void *user, void *ptr)
+{
+    (void) user;
+    free(ptr);
+}
+
+static const struct ini_allocator ini_stdlib_allocator = {
+    ini_stdlib_allocate, ini_stdlib_reallocate, ini_stdlib_deallocate, NULL
 };
 
+#define INI_DEFAULT_ALLOCATOR               (&ini_stdlib_allocator)
+#endif /* INI_DEFAULT_ALLOCATOR */
+
+/**
+ * Allocates `size` bytes with `allocator`, or with
+ * `INI_DEFAULT_ALLOCATOR` if it is NULL. Returns NULL on error.
+*/
+static void *ini_allocate(const struct ini_allocator *allocator, size_t size)
+{
+    if (allocator == NULL)
+        allocator = INI_DEFAULT_ALLOCATOR;
+
+    return allocator->allocate(allocator->user, size);
+}
+
+/**
+ * Same as `ini_allocate`, but for `count` elements of `size` bytes,
+ * which are set to zero.
+*/
+static void *ini_callocate(const struct ini_allocator *allocator,
+                           size_t count, size_t size)
+{
+    void *ptr;
+
+    if (size != 0 && count > SIZE_MAX / size)
+        return NULL;
+
+    if ((ptr = ini_allocate(allocator, count * size)) != NULL)
+        memset(ptr, 0, count * size);
+
+    return ptr;
+}
+
+/**
+ * Resizes `ptr`, which may be NULL, to `size` bytes with `allocator`.
+ * Returns NULL on error, in which case `ptr` is left intact.
+*/
+static void *ini_reallocate(const struct ini_allocator *allocator,
+                            void *ptr, size_t size)
+{
+    if (allocator == NULL)
+        allocator = INI_DEFAULT_ALLOCATOR;
+
+    return allocator->reallocate(allocator->user, ptr, size);
+}
+
+/**
+ * Frees `ptr`, which may be NULL, with `allocator`.
+*/
+static void ini_deallocate(const struct ini_allocator *allocator, void *ptr)
+{
+    if (allocator == NULL)
+        allocator = INI_DEFAULT_ALLOCATOR;
+
+    if (ptr != NULL)
+        allocator->deallocate(allocator->user, ptr);
+}
+
 /**
  * Creates a `str` duplicate and returns a pointer to it. In case of
  * error, NULL is returned. `size` - the size of the string to be
@@ -123,7 +938,7 @@ static char *ini_strndup(const char *str, size_t size)
     char *tmp = NULL;
 
     if (str != NULL) {
-        tmp = (char*) calloc(size + 1, sizeof *tmp);
+        tmp = (char*) ini_callocate(NULL, size + 1, sizeof *tmp);
 
         if (tmp != NULL)
             strncpy(tmp, str, size);
@@ -186,679 +1001,5318 @@ static unsigned int ini_djb2_hash(const char *str)
     return hash;
 }
 
+#define INI_WY_SECRET0                      UINT64_C(0xa0761d6478bd642f)
+#define INI_WY_SECRET1                      UINT64_C(0xe7037ed1a0b428db)
+#define INI_WY_SECRET2                      UINT64_C(0x8ebc6af09c88c6e3)
+#define INI_WY_SECRET3                      UINT64_C(0x589965cc75374cc3)
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128     ini_uint128_t;
+#endif /* __SIZEOF_INT128__ */
+
 /**
- * Creates a new hash map and returns NULL on error.
- * 
- * WARNING: If the `free_fn` function pointer is NULL, the hash map
- * values will not be freed and a memory leak may occur.
+ * Reads a little-endian 64-bit integer from `p`.
 */
-static struct ini_map *ini_map_new(ini_map_free_value free_fn)
+static uint64_t ini_read64(const unsigned char *p)
 {
-    struct ini_map *map = (struct ini_map*) malloc(sizeof *map);
-
-    if (map != NULL) {
-        memset(map, 0, sizeof *map);
-
-        map->capacity = INI_MAP_START_CAPACITY;
-        map->free = free_fn;
-        map->values = (struct ini_map_entry**)
-                calloc(map->capacity, sizeof *map->values);
-
-        if (!map->values) {
-            free(map);
-            return NULL;
-        }
-    }
-
-    return map;
+    return (uint64_t) p[0]       | (uint64_t) p[1] << 8
+         | (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24
+         | (uint64_t) p[4] << 32 | (uint64_t) p[5] << 40
+         | (uint64_t) p[6] << 48 | (uint64_t) p[7] << 56;
 }
 
 /**
- * Creates a new hash table entry. Returns a pointer to the new
- * element of the hash table, or NULL on error.
- */
-static struct ini_map_entry*
-ini_map_entry_new(unsigned int hash, const char *key, void *value)
+ * Reads a little-endian 32-bit integer from `p`.
+*/
+static uint64_t ini_read32(const unsigned char *p)
 {
-    struct ini_map_entry *entry = (struct ini_map_entry*)
-        malloc(sizeof *entry);
-    
-    if (entry != NULL) {
-        entry->hash = hash;
-        entry->key = ini_strdup(key);
-        entry->value = value;
-        entry->next = NULL;
-    }
-
-    return entry;
+    return (uint64_t) p[0]       | (uint64_t) p[1] << 8
+         | (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24;
 }
 
 /**
- * Expands the hash table by doubling its capacity and rehashing all
- * elements. Returns nothing, but may change the hash table pointer
- * if memory is re-allocated.
+ * Multiplies `a` and `b` into a 128-bit product, and stores its low
+ * half in `a` and its high half in `b`.
 */
-static void ini_map_expand(struct ini_map *map)
+static void ini_mum(uint64_t *a, uint64_t *b)
 {
-    struct ini_map_entry *entry, *next;
-    struct ini_map_entry **old_values;
-    size_t old_capacity;
-    size_t i, index;
-
-    if (map == NULL)
-        return;
-
-    if ((double)map->size / map->capacity > INI_MAP_LOAD_FACTOR) {
-        old_capacity = map->capacity;
-        old_values = map->values;
-
-        map->capacity <<= 1;
-        map->values = (struct ini_map_entry**)
-            calloc(map->capacity, sizeof *map->values);
-
-        if (map->values == NULL) {
-            map->capacity = old_capacity;
-            map->values = old_values;
-            return;
-        }
+#ifdef __SIZEOF_INT128__
+    ini_uint128_t product = (ini_uint128_t) *a * *b;
+
+    *a = (uint64_t) product;
+    *b = (uint64_t) (product >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32;
+    uint64_t la = (uint32_t) *a, lb = (uint32_t) *b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), carry = (t < rl);
+    uint64_t lo = t + (rm1 << 32);
+
+    carry += (lo < t);
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif /* __SIZEOF_INT128__ */
+}
 
-        for (i = 0; i < old_capacity; ++i) {
-            entry = old_values[i];
-            
-            while (entry != NULL) {
-                next = entry->next;
-                index = ini_map_index(entry->hash, map->capacity);
-                entry->next = map->values[index];
-                map->values[index] = entry;
-                entry = next;
-            }
-        }
-        
-        free(old_values);
-    }
+static uint64_t ini_mix(uint64_t a, uint64_t b)
+{
+    ini_mum(&a, &b);
+    return a ^ b;
 }
 
 /**
- * Associates the specified value with the specified key in this map.
- * Does nothing if `map` or `key` is NULL. Returns true if everything
- * went well.
- * 
- * NOTE: Creates a copy of the `key` string inside. If you have
- * allocated memory for `key`, don't forget to free it.
+ * Same as `ini_wyhash`, but `seed` has already been mixed with the
+ * secret, which lets constant seeds be folded at compile time.
 */
-static bool ini_map_put(struct ini_map *map, const char *key, void *value)
+static uint64_t ini_wyhash_mixed(const char *str, size_t size, uint64_t seed)
 {
-    unsigned int hash;
-    struct ini_map_entry *entry;
-    size_t index;
-
-    if (map == NULL && key == NULL && *key == '\0')
-        return false;
-
-    hash = ini_djb2_hash(key);
-    index = ini_map_index(hash, map->capacity);
-    entry = map->values[index];
-
-    while (entry != NULL) {
-        if (ini_map_keys_equal(hash, key, entry->hash, entry->key)) {
-            if (map->free != NULL)
-                map->free(entry->value);
-
-            entry->value = value;
-            return true;
+    const unsigned char *p = (const unsigned char*) str;
+    uint64_t a, b, see1, see2;
+    size_t i = size;
+
+    if (size <= 16) {
+        if (size >= 4) {
+            a = (ini_read32(p) << 32) | ini_read32(p + ((size >> 3) << 2));
+            b = (ini_read32(p + size - 4) << 32)
+              | ini_read32(p + size - 4 - ((size >> 3) << 2));
         }
-        
-        entry = entry->next;
+        else if (size > 0) {
+            a = ((uint64_t) p[0] << 16) | ((uint64_t) p[size >> 1] << 8)
+              | p[size - 1];
+            b = 0;
+        }
+        else
+            a = b = 0;
     }
-    
-    entry = ini_map_entry_new(hash, key, value);
+    else {
+        if (i > 48) {
+            see1 = see2 = seed;
+
+            do {
+                seed = ini_mix(ini_read64(p) ^ INI_WY_SECRET1,
+                               ini_read64(p + 8) ^ seed);
+                see1 = ini_mix(ini_read64(p + 16) ^ INI_WY_SECRET2,
+                               ini_read64(p + 24) ^ see1);
+                see2 = ini_mix(ini_read64(p + 32) ^ INI_WY_SECRET3,
+                               ini_read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+
+            seed ^= see1 ^ see2;
+        }
 
-    if (entry != NULL) {
-        entry->next = map->values[index];
-        map->values[index] = entry;
-        map->size++;
-        ini_map_expand(map);
-        return true;
+        while (i > 16) {
+            seed = ini_mix(ini_read64(p) ^ INI_WY_SECRET1,
+                           ini_read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+
+        a = ini_read64(p + i - 16);
+        b = ini_read64(p + i - 8);
     }
 
-    return false;
+    a ^= INI_WY_SECRET1;
+    b ^= seed;
+    ini_mum(&a, &b);
+    return ini_mix(a ^ INI_WY_SECRET0 ^ size, b ^ INI_WY_SECRET1);
 }
 
 /**
- * Returns the value associated with the specified key, or NULL if
- * this map does not contain the given key.
+ * Hash function to get the 64-bit hash of the first `size` characters
+ * of `str`, which doesn't have to end with `\0`, seeded with `seed`.
+ * Used in hash maps to look up the value of a key.
+ * 
+ * It follows wyhash (final version 4) with its default secret: keys of
+ * up to 16 characters, which are the common case, take two 128-bit
+ * multiplications.
+ * 
+ * Read more: https://github.com/wangyi-fudan/wyhash
 */
-static void *ini_map_get(struct ini_map *map, const char *key)
+static uint64_t ini_wyhash(const char *str, size_t size, uint64_t seed)
 {
-    struct ini_map_entry *entry;
-    void *value = NULL;
-    unsigned int hash;
-
-    if (map != NULL && key != NULL) {
-        hash = ini_djb2_hash(key);
-        entry = map->values[ini_map_index(hash, map->capacity)];
-
-        while (entry != NULL) {
-            if (ini_map_keys_equal(entry->hash, entry->key, hash, key))
-                return entry->value;
-            else
-                entry = entry->next;
-        }
-    }
-
-    return value;
+    seed ^= ini_mix(seed ^ INI_WY_SECRET0, INI_WY_SECRET1);
+    return ini_wyhash_mixed(str, size, seed);
 }
 
 /**
- * Returns an array of pointers to the ini_map_entry elements via the
- * `entries` pointer, stored in the ini_map structure. This function
- * can be used to iterate over all key-value pairs in a hash map.
- * The function returns the number of elements in the `entries` array.
- * If an error occurs, the function returns 0.
- * 
- * WARNING: Memory is allocated for `entries`. Don't forget to free it
- * with `free`
+ * Returns the hash of the first `size` characters of `str` used by
+ * `ini_map`, seeded with `INI_HASH_SEED`.
 */
-static size_t
-ini_map_enumerate(struct ini_map *map, struct ini_map_entry ***entries)
+static uint64_t ini_hash(const char *str, size_t size)
 {
-    struct ini_map_entry *entry;
-    size_t count = 0;
-    size_t i;
-
-    if (map == NULL && entries == NULL)
-        return 0;
-
-    *entries = (struct ini_map_entry **)
-        malloc(map->size * sizeof(struct ini_map_entry*));
-    
-    if (*entries == NULL)
-        return 0;
-    
-    for (i = 0; i < map->capacity; ++i) {
-        entry = map->values[i];
-
-        while (entry != NULL) {
-            (*entries)[count++] = entry;
-            entry = entry->next;
-        }
-    }
-    
-    return count;
+    return ini_wyhash_mixed(str, size, INI_HASH_SEED
+        ^ ini_mix(INI_HASH_SEED ^ INI_WY_SECRET0, INI_WY_SECRET1));
 }
 
 /**
- * Frees memory for `map`
+ * Appends a new block of at least `size` bytes of data to the arena.
+ * Returns NULL on error.
 */
-static void ini_map_free(struct ini_map *map)
+static struct ini_arena_block *
+ini_arena_grow(struct ini_arena *arena, size_t size)
 {
-    struct ini_map_entry **entries, *cur;
-    size_t size;
-    int i;
+    struct ini_arena_block *block;
+    size_t block_size = arena->block_size;
 
-    if (map != NULL && map->values) {
-        size = ini_map_enumerate(map, &entries);
+    if (block_size < size)
+        block_size = size;
 
-        for (i = 0; i < size; ++i) {
-            cur = entries[i];
+    block = (struct ini_arena_block*)
+        ini_allocate(arena->allocator, sizeof *block + block_size);
 
-            if (cur->value != NULL && map->free != NULL)
-                map->free(cur->value);
+    if (block != NULL) {
+        block->next = arena->head;
+        block->size = block_size;
+        block->used = 0;
 
-            free(cur->key);
-            free(cur);
-        }
+        arena->head = block;
 
-        free(entries);
-        free(map->values);
-        free(map);
+        /* Keep the number of blocks logarithmic */
+        arena->block_size <<= 1;
     }
-}
 
-/**
- * Creates a new ini_t object, which is a data structure for working
- * with INI files.
-*/
-static ini_t ini_new(void) {
-    return ini_map_new((ini_map_free_value) ini_map_free);
+    return block;
 }
 
 /**
- * Retrieves a string from the specified section in `ini` by key.
- * 
- * Returns the value of the key `key` in the `section`, otherwise, if,
- * for example, the key does not exist, returns the value `def`.
+ * Returns a pointer to `size` bytes of memory aligned to `align`, which
+ * must be a power of two. Returns NULL on error.
  * 
- * If `section` is NULL, then the default `INI_DEFAULT_SECTION_NAME`
- * constant will be used.
+ * NOTE: Memory is never released individually, only by
+ * `ini_arena_free`.
 */
-static const char*
-ini_get(ini_t ini, const char *section, const char *key, const char *def)
+static void *ini_arena_alloc(struct ini_arena *arena, size_t size,
+                             size_t align)
 {
-    struct ini_map *_section;
-    const char *section_name = section ? section : INI_DEFAULT_SECTION_NAME;
-    const char *value = NULL;
+    struct ini_arena_block *block;
+    uintptr_t start, offset;
 
-    if (ini != NULL && key != NULL && ini->size > 0) {
-        _section = (struct ini_map*) ini_map_get(ini, section_name);
+    if (arena == NULL)
+        return NULL;
 
-        if (_section != NULL)
-            value = (const char *) ini_map_get(_section, key);
+    block = arena->head;
+
+    if (block == NULL || block->size - block->used < size + align) {
+        block = ini_arena_grow(arena, size + align);
+
+        if (block == NULL)
+            return NULL;
     }
 
-    return (value != NULL) ? value : def;
+    start = (uintptr_t) (block + 1) + block->used;
+    offset = (start + align - 1) & ~((uintptr_t) align - 1);
+
+    block->used += (size_t) (offset - start) + size;
+    return (void*) offset;
 }
 
 /**
- * Associates a string with a key in the specified section in `ini`.
- * 
- * If `section` is NULL, then the default `INI_DEFAULT_SECTION_NAME`
- * constant will be used.
- * 
- * NOTE: You can also assign NULL to `value` to make the value not
- * equal to anything.
+ * Creates a new arena whose first block holds at least `size_hint`
+ * bytes. The arena itself lives in its first block, and blocks are
+ * allocated with `allocator` (NULL for INI_DEFAULT_ALLOCATOR). Returns
+ * NULL on error.
 */
-static void
-ini_set(ini_t ini, const char *section, const char *key, const char *value)
+static struct ini_arena *
+ini_arena_new(size_t size_hint, const struct ini_allocator *allocator)
 {
-    struct ini_map *_section;
-    const char *section_name = section ? section : INI_DEFAULT_SECTION_NAME;
+    struct ini_arena tmp = {0};
+    struct ini_arena *arena;
 
-    if (ini != NULL && key != NULL) {
-        _section = (struct ini_map*) ini_map_get(ini, section_name);
+    tmp.block_size = size_hint ? size_hint : INI_ARENA_BLOCK_SIZE;
+    tmp.allocator = allocator;
 
-        if (_section == NULL) {
-            _section = ini_map_new(free);
-            ini_map_put(ini, section_name, _section);
-        }
+    arena = (struct ini_arena*)
+        ini_arena_alloc(&tmp, sizeof *arena, INI_ARENA_ALIGNMENT);
 
-        ini_map_put(_section, key, (void*) ini_strdup(value));
-    }
-}
+    if (arena != NULL)
+        *arena = tmp;
 
-/**
- * Frees memory for `ini`
-*/
-static void ini_free(ini_t ini)
-{
-    if (ini != NULL)
-        ini_map_free(ini);
+    return arena;
 }
 
 /**
- * Checks if the end of a line has been reached in the I/O stream.
+ * Frees all blocks of `arena`, including the arena itself.
 */
-static bool ini_io_string_eof(struct ini_io *io)
+static void ini_arena_free(struct ini_arena *arena)
 {
-    const char *p = (const char*) io->raw;
-    return (bool) ((io != NULL) ? (*p == '\0') : true);
+    struct ini_arena_block *block, *next;
+    const struct ini_allocator *allocator;
+
+    if (arena != NULL) {
+        /* The arena goes away with its first block */
+        allocator = arena->allocator;
+        block = arena->head;
+
+        while (block != NULL) {
+            next = block->next;
+            ini_deallocate(allocator, block);
+            block = next;
+        }
+    }
 }
 
 /**
- * Returns the next character from the I/O string stream.
+ * Allocates `size` bytes for `map`, either in its arena or on the
+ * heap. Returns NULL on error.
 */
-static int ini_io_string_getc(struct ini_io *io)
+static void *ini_map_alloc(struct ini_map *map, size_t size)
 {
-    int ch = EOF;
-    const char *p = (const char*) io->raw;
-
-    if (io == NULL) return ch;
-    if (!io->eof(io)) ch = *p++;
-    
-    io->raw = (void*) p;
-    io->peek = ch;
-    return ch;
-}
+    if (map->arena != NULL)
+        return ini_arena_alloc(map->arena, size, INI_ARENA_ALIGNMENT);
 
-/**
- * Checks if the end of the file has been reached in the I/O stream.
-*/
-static bool ini_io_file_eof(struct ini_io *io)
-{
-    return (bool) ((io != NULL) ? feof((FILE*) io->raw) : true);
+    return ini_allocate(map->allocator, size);
 }
 
 /**
- * Returns the next character from the I/O file stream.
+ * Releases memory obtained from `ini_map_alloc`. Arena memory is left
+ * in place until the arena is freed.
 */
-static int ini_io_file_getc(struct ini_io *io)
+static void ini_map_release(struct ini_map *map, void *ptr)
 {
-    if (io->eof(io))
-        io->peek = EOF;
-    else
-        io->peek = fgetc((FILE*) io->raw);
-
-    return io->peek;
+    if (map->arena == NULL)
+        ini_deallocate(map->allocator, ptr);
 }
 
 /**
- * Writes the character ch to the I/O file stream.
+ * Frees a string value of `map`.
 */
-static void ini_io_file_putc(struct ini_io *io, int ch)
+static void ini_map_free_string(struct ini_map *map, void *ptr)
 {
-    if (io != NULL)
-        fputc(ch, (FILE*) io->raw);
+    ini_map_release(map, ptr);
 }
 
 /**
- * Reads a line from the I/O input stream and returns it. Returns NULL
- * if the end of file has been reached or an error has occurred.
+ * Same as `ini_strndup`, but the duplicate is allocated with
+ * `ini_map_alloc`.
 */
-static char *ini_io_read_line(struct ini_io *io)
+static char *ini_map_strndup(struct ini_map *map, const char *str,
+                             size_t size)
 {
-    size_t size = 0;
-    size_t capacity = 0;
-    char *buffer = NULL;
-    char *block;
-
-    if (io != NULL && io->mode == INI_IO_MODE_READ) {
-        while (!io->eof(io)) {
-            if (io->getc(io) == '\n' || io->peek == EOF)
-                break;
-
-            if ((size + 1) >= capacity) {
-                capacity += 64;
+    char *tmp = NULL;
 
-                block = (char*) realloc(buffer, capacity);
+    if (str == NULL)
+        return NULL;
 
-                if (block)
-                    buffer = block;
-                else
-                    break;
-            }
+    if (map->arena != NULL)
+        tmp = (char*) ini_arena_alloc(map->arena, size + 1, 1);
+    else
+        tmp = (char*) ini_allocate(map->allocator, size + 1);
 
-            buffer[size++] = io->peek;
-            buffer[size] = '\0';
-        }
+    if (tmp != NULL) {
+        memcpy(tmp, str, size);
+        tmp[size] = '\0';
     }
 
-    return buffer;
+    return tmp;
 }
 
+#define ini_map_strdup(map, str)                                            \
+    ((str) ? ini_map_strndup(map, str, strlen(str)) : NULL)
+
 /**
- * Writes the string line to the output stream I/O.
+ * Allocates `capacity` empty slots, where `capacity` is a power of two,
+ * and makes them the slots of `map`. Returns false on error.
 */
-static void ini_io_write(struct ini_io *io, const char *line)
+static bool ini_map_alloc_slots(struct ini_map *map, size_t capacity)
 {
-    if (line != NULL && io != NULL && io->mode == INI_IO_MODE_WRITE) {
-        while (*line != '\0')
-            io->putc(io, *line++);
-    }
+    struct ini_map_slot *slots = (struct ini_map_slot*)
+        ini_map_alloc(map, capacity * sizeof *slots);
+
+    if (slots == NULL)
+        return false;
+
+    memset(slots, 0, capacity * sizeof *slots);
+
+    map->slots = slots;
+    map->capacity = capacity;
+    return true;
 }
 
 /**
- * The ini_parse_line_section function parses the line containing the
- * section name and creates a new section in the ini_t structure.
+ * Puts `entry` with the hash `hash` into the table, moving aside the
+ * elements that are closer to their home slots. The key must not be in
+ * the map yet.
 */
 static void
-ini_parse_line_section(struct ini_parse_state *state, const char *line)
+ini_map_place(struct ini_map *map, uint64_t hash, struct ini_map_entry *entry)
 {
-    struct ini_map *section;
-    char *section_name;
-    const char *end;
+    struct ini_map_slot carry, tmp, *slot;
+    size_t index = ini_map_index(hash, map->capacity);
+    size_t distance = 0;
+    size_t resident;
 
-    if (line != NULL && *line == '[') {
-        end = strchr(line, ']');
+    carry.hash = hash;
+    carry.entry = entry;
 
-        if (end == NULL)
-            return;
+    for (;;) {
+        slot = &map->slots[index];
 
-        section_name = ini_strndup(line + 1, end - line - 1);
-        
-        if (section_name == NULL)
+        if (slot->entry == NULL) {
+            *slot = carry;
             return;
+        }
 
-        section = (struct ini_map*)
-            ini_map_get(state->ini, section_name);
-
-        if (section == NULL) {
-            section = ini_map_new(free);
+        resident = ini_map_distance(slot->hash, index, map->capacity);
 
-            if (section == NULL)
-                goto clean;
-            
-            ini_map_put(state->ini, section_name, section);
+        if (resident < distance) {
+            tmp = *slot;
+            *slot = carry;
+            carry = tmp;
+            distance = resident;
         }
 
-        state->cur_section = section;
-
-clean:
-        free(section_name);
+        index = (index + 1) & (map->capacity - 1);
+        distance++;
     }
 }
 
 /**
- * The ini_parse_line function parses one line from the I/O stream and
- * updates the parse state.
+ * Returns the entry of the first `size` characters of `key` with the
+ * hash `hash`, or NULL if this map does not contain the given key.
 */
-static void ini_parse_line(struct ini_parse_state *state, const char *line)
+static struct ini_map_entry *
+ini_map_find(struct ini_map *map, uint64_t hash, const char *key, size_t size)
 {
-    size_t pos = 0;
-    char *value, *unquoted_value;
-    char *key;
+    size_t index = ini_map_index(hash, map->capacity);
+    size_t distance = 0;
+    struct ini_map_slot *slot;
 
-    if (line != NULL && *line != '\0') {
-        pos = strcspn(line, INI_KEY_VALUE_SEPARATORS);
+    for (;;) {
+        slot = &map->slots[index];
 
-        if (pos != strlen(line)) {
-            key = ini_strtrim(ini_strndup(line, pos));
-            value = ini_strtrim(ini_strdup(line + pos + 1));
-            unquoted_value = ini_strdup(value);
-
-            if (key == NULL || value == NULL || unquoted_value == NULL)
-                return;
+        if (slot->entry == NULL)
+            return NULL;
 
-            if (*unquoted_value != '\0') {
-                sscanf(value, "\"%[^\"]\"", unquoted_value);
-                ini_map_put(state->cur_section, key, unquoted_value);
-            }
-            else
-                free(unquoted_value);
+        /* A Robin Hood table would have placed the key before */
+        if (distance > ini_map_distance(slot->hash, index, map->capacity))
+            return NULL;
 
-            free(value);
-            free(key);
+        if (slot->hash == hash && slot->entry->size == size
+            && memcmp(slot->entry->key, key, size) == 0)
+        {
+            return slot->entry;
         }
-        else
-            ini_parse_line_section(state, line);
+
+        index = (index + 1) & (map->capacity - 1);
+        distance++;
     }
 }
 
 /**
- * The ini_parse function parses the I/O stream and creates an ini_t
- * structure with configuration data.
+ * Creates a new hash map in `arena` and returns NULL on error. If
+ * `arena` is NULL, the map is allocated with `allocator`, or with
+ * INI_DEFAULT_ALLOCATOR if that is NULL too.
  * 
- * The following fields of the I/O structure must not be NULL:
- * - raw 
- * - mode (should be INI_IO_MODE_READ)
- * - getc
- * - eof 
+ * WARNING: If the `free_fn` function pointer is NULL, the hash map
+ * values will not be freed and a memory leak may occur.
 */
-static ini_t ini_parse(struct ini_io *io, struct ini_parse_state *state)
+static struct ini_map *
+ini_map_new_in(struct ini_arena *arena, const struct ini_allocator *allocator,
+               ini_map_free_value free_fn)
 {
-    char *line;
-    size_t comment_pos;
-
-    if (io == NULL && io->mode == INI_IO_MODE_READ)
-        goto ret;
-
-    state->ini = ini_new();
-    state->cur_section = ini_map_new(free);
+    struct ini_map tmp = {0};
+    struct ini_map *map;
 
-    /* Add a DEFAULT section */
-    ini_map_put(state->ini, INI_DEFAULT_SECTION_NAME, state->cur_section);
-
-    while (!io->eof(io)) {
-        line = ini_io_read_line(io);
+    tmp.arena = arena;
+    tmp.allocator = allocator;
+    map = (struct ini_map*) ini_map_alloc(&tmp, sizeof *map);
 
-        if (line != NULL && *line != '\0') {
-            /* Remove a comment */
-            comment_pos = strcspn(line, INI_COMMENT_SYMBOLS);
-            line[comment_pos] = '\0';
+    if (map != NULL) {
+        *map = tmp;
+        map->free = free_fn;
 
-            /* Trim & parse */
-            ini_strtrim(line);
-            ini_parse_line(state, line);
+        if (!ini_map_alloc_slots(map, INI_MAP_START_CAPACITY)) {
+            ini_map_release(map, map);
+            return NULL;
         }
-
-        free(line);
     }
 
-ret:
-    return state->ini;
+    return map;
 }
 
 /**
- * Writes section properties to the I/O stream.
+ * Creates a new hash map and returns NULL on error.
+ * 
+ * WARNING: If the `free_fn` function pointer is NULL, the hash map
+ * values will not be freed and a memory leak may occur.
 */
-static size_t ini_store_section(struct ini_io *io, struct ini_map *sec)
+static struct ini_map *ini_map_new(ini_map_free_value free_fn)
 {
-    struct ini_map_entry **entries, *cur;
-    size_t size = 0;
-    int i;
+    return ini_map_new_in(NULL, NULL, free_fn);
+}
 
-    if (sec != NULL && io != NULL && io->mode == INI_IO_MODE_WRITE) {
-        size = ini_map_enumerate(sec, &entries);
-
-        for (i = 0; i < size; ++i) {
-            cur = entries[i];
-
-            if (cur->key != NULL) {
-                ini_io_write(io, cur->key);
-                io->putc(io, ' ');
-                io->putc(io, INI_KEY_VALUE_SEPARATORS[0]);
-                io->putc(io, ' ');
-                ini_io_write(io, (const char*) cur->value);
-                io->putc(io, '\n');
-            }
+/**
+ * Creates a new hash table entry. Returns a pointer to the new
+ * element of the hash table, or NULL on error. A copied key is stored
+ * right after the entry, so comparing it doesn't touch another block.
+ * 
+ * If `borrow` is true and the map lives in an arena, `key` must end
+ * with `\0` at `key_size` and is referenced instead of copied.
+ */
+static struct ini_map_entry*
+ini_map_entry_new(struct ini_map *map, uint64_t hash, const char *key,
+                  size_t key_size, void *value, bool borrow)
+{
+    struct ini_map_entry *entry;
+    size_t size = sizeof *entry;
+
+    borrow = borrow && map->arena != NULL;
+
+    if (!borrow)
+        size += key_size + 1;
+
+    entry = (struct ini_map_entry*) ini_map_alloc(map, size);
+
+    if (entry == NULL)
+        return NULL;
+
+    if (borrow)
+        entry->key = (char*) key;
+    else {
+        entry->key = (char*) (entry + 1);
+        memcpy(entry->key, key, key_size);
+        entry->key[key_size] = '\0';
+    }
+
+    entry->hash = hash;
+    entry->value = value;
+    entry->size = key_size;
+    entry->next = NULL;
+    entry->cached_type = INI_TYPE_NONE;
+
+    if (map->last != NULL)
+        map->last->next = entry;
+    else
+        map->first = entry;
+
+    map->last = entry;
+    return entry;
+}
+
+/**
+ * Grows the hash table, doubling its capacity as many times as needed
+ * for `size` elements to stay within `INI_MAP_LOAD_FACTOR`, and
+ * rehashes all elements. Entries themselves are not moved. Returns
+ * false on error.
+*/
+static bool ini_map_reserve(struct ini_map *map, size_t size)
+{
+    struct ini_map_slot *old_slots;
+    size_t old_capacity, capacity;
+    size_t i;
+
+    if (map == NULL)
+        return false;
+
+    for (capacity = map->capacity;
+         (double) size / capacity > INI_MAP_LOAD_FACTOR; capacity <<= 1);
+
+    if (capacity == map->capacity)
+        return true;
+
+    old_capacity = map->capacity;
+    old_slots = map->slots;
+
+    if (!ini_map_alloc_slots(map, capacity))
+        return false;
+
+    for (i = 0; i < old_capacity; ++i) {
+        if (old_slots[i].entry != NULL)
+            ini_map_place(map, old_slots[i].hash, old_slots[i].entry);
+    }
+
+    ini_map_release(map, old_slots);
+
+    INI_STATS(++map->counters.rehashes);
+    INI_ON_REHASH(map, capacity);
+    return true;
+}
+
+/**
+ * Expands the hash table by doubling its capacity and rehashing all
+ * elements, if the load factor exceeds `INI_MAP_LOAD_FACTOR` after
+ * adding one more element.
+*/
+static void ini_map_expand(struct ini_map *map)
+{
+    if (map != NULL)
+        ini_map_reserve(map, map->size + 1);
+}
+
+/**
+ * Frees the value of `entry` with the free function of `map`, unless
+ * it is stored inside the entry.
+*/
+static void ini_map_entry_release(struct ini_map *map,
+                                  struct ini_map_entry *entry)
+{
+    if (entry->value != NULL && entry->value != entry->inline_value
+        && map->free != NULL)
+        map->free(map, entry->value);
+}
+
+/**
+ * Returns the entry of the key with the hash `hash` in `map`, adding
+ * it with a NULL value if it isn't there yet. See `ini_map_entry_new`
+ * for the meaning of `borrow`. Returns NULL on error.
+*/
+static struct ini_map_entry *
+ini_map_upsert(struct ini_map *map, uint64_t hash, const char *key,
+               size_t size, bool borrow)
+{
+    struct ini_map_entry *entry = ini_map_find(map, hash, key, size);
+
+    if (entry != NULL)
+        return entry;
+
+    ini_map_expand(map);
+
+    /* Keep at least one empty slot for the probe sequences to end */
+    if (map->size + 1 >= map->capacity)
+        return NULL;
+
+    entry = ini_map_entry_new(map, hash, key, size, NULL, borrow);
+
+    if (entry == NULL)
+        return NULL;
+
+    ini_map_place(map, hash, entry);
+    map->size++;
+    return entry;
+}
+
+/**
+ * Replaces the value of `entry` in `map` with `value`, freeing the old
+ * one.
+*/
+static void ini_map_entry_assign(struct ini_map *map,
+                                 struct ini_map_entry *entry, void *value)
+{
+    ini_map_entry_release(map, entry);
+
+    entry->value = value;
+    entry->cached_type = INI_TYPE_NONE;
+    map->digest_valid = false;
+}
+
+/**
+ * Replaces the value of `entry` in `map` with a copy of the first
+ * `size` characters of `value`, or with NULL if `value` is NULL.
+ * Values shorter than INI_ENTRY_INLINE_SIZE are copied into the entry
+ * instead of a new block. Returns false on error, in which case the
+ * old value is kept.
+*/
+static bool ini_map_entry_assign_n(struct ini_map *map,
+                                   struct ini_map_entry *entry,
+                                   const char *value, size_t size)
+{
+    char *copy;
+
+    if (value == NULL || size >= INI_ENTRY_INLINE_SIZE) {
+        copy = ini_map_strndup(map, value, size);
+
+        if (copy == NULL && value != NULL)
+            return false;
+
+        ini_map_entry_assign(map, entry, copy);
+        return true;
+    }
+
+    /* `value` may point into the old value */
+    memmove(entry->inline_value, value, size);
+    entry->inline_value[size] = '\0';
+
+    ini_map_entry_assign(map, entry, entry->inline_value);
+    return true;
+}
+
+/**
+ * Same as `ini_map_insert`, but with the hash of the key computed by
+ * `ini_hash` in advance.
+*/
+static bool ini_map_insert_hashed(struct ini_map *map, uint64_t hash,
+                                  const char *key, size_t size, void *value,
+                                  bool borrow)
+{
+    struct ini_map_entry *entry;
+
+    map->digest_valid = false;
+    entry = ini_map_upsert(map, hash, key, size, borrow);
+
+    if (entry == NULL)
+        return false;
+
+    ini_map_entry_assign(map, entry, value);
+    return true;
+}
+
+/**
+ * Associates a copy of the first `value_size` characters of `value`
+ * with the first `size` characters of `key` in this map, which must
+ * hold strings. Returns true if everything went well.
+*/
+static bool ini_map_insert_string(struct ini_map *map, const char *key,
+                                  size_t size, const char *value,
+                                  size_t value_size)
+{
+    struct ini_map_entry *entry;
+
+    if (map == NULL || key == NULL)
+        return false;
+
+    entry = ini_map_upsert(map, ini_hash(key, size), key, size, false);
+
+    if (entry == NULL)
+        return false;
+
+    return ini_map_entry_assign_n(map, entry, value, value_size);
+}
+
+/**
+ * Associates the specified value with the first `size` characters of
+ * `key` in this map. See `ini_map_entry_new` for the meaning of
+ * `borrow`. Returns true if everything went well.
+*/
+static bool ini_map_insert(struct ini_map *map, const char *key, size_t size,
+                           void *value, bool borrow)
+{
+    if (map == NULL || key == NULL)
+        return false;
+
+    return ini_map_insert_hashed(map, ini_hash(key, size), key, size, value,
+                                 borrow);
+}
+
+/**
+ * Associates the specified value with the first `size` characters of
+ * `key` in this map. Does nothing if `map` or `key` is NULL. Returns
+ * true if everything went well.
+ * 
+ * NOTE: Creates a copy of the `key` string inside. If you have
+ * allocated memory for `key`, don't forget to free it.
+*/
+static bool ini_map_put_n(struct ini_map *map, const char *key, size_t size,
+                          void *value)
+{
+    return ini_map_insert(map, key, size, value, false);
+}
+
+/**
+ * Associates the specified value with the specified key in this map.
+ * Does nothing if `map` or `key` is NULL. Returns true if everything
+ * went well.
+ * 
+ * NOTE: Creates a copy of the `key` string inside. If you have
+ * allocated memory for `key`, don't forget to free it.
+*/
+static bool ini_map_put(struct ini_map *map, const char *key, void *value)
+{
+    if (map == NULL || key == NULL)
+        return false;
+
+    return ini_map_put_n(map, key, strlen(key), value);
+}
+
+/**
+ * Returns the value associated with the first `size` characters of
+ * `key`, or NULL if this map does not contain the given key.
+*/
+static void *ini_map_get_n(struct ini_map *map, const char *key, size_t size)
+{
+    struct ini_map_entry *entry = NULL;
+
+    if (map != NULL && key != NULL)
+        entry = ini_map_find(map, ini_hash(key, size), key, size);
+
+    return (entry != NULL) ? entry->value : NULL;
+}
+
+/**
+ * Returns the value associated with the specified key, or NULL if
+ * this map does not contain the given key.
+*/
+static void *ini_map_get(struct ini_map *map, const char *key)
+{
+    if (map == NULL || key == NULL)
+        return NULL;
+
+    return ini_map_get_n(map, key, strlen(key));
+}
+
+/**
+ * Returns an array of pointers to the ini_map_entry elements via the
+ * `entries` pointer, stored in the ini_map structure, in insertion
+ * order. This function can be used to iterate over all key-value pairs
+ * in a hash map. The function returns the number of elements in the
+ * `entries` array. If an error occurs, the function returns 0.
+ * 
+ * WARNING: Memory is allocated for `entries` with INI_DEFAULT_ALLOCATOR.
+ * Don't forget to free it with `ini_deallocate(NULL, entries)`
+*/
+static size_t
+ini_map_enumerate(struct ini_map *map, struct ini_map_entry ***entries)
+{
+    struct ini_map_entry *cur;
+    size_t count = 0;
+
+    if (map == NULL || entries == NULL)
+        return 0;
+
+    *entries = (struct ini_map_entry **)
+        ini_allocate(NULL, (map->size + 1) * sizeof(struct ini_map_entry*));
+    
+    if (*entries == NULL)
+        return 0;
+    
+    for (cur = map->first; cur != NULL; cur = cur->next)
+        (*entries)[count++] = cur;
+    
+    return count;
+}
+
+/**
+ * Prepares `iter` to walk the keys of `section` in insertion order
+ * with `ini_key_iter_next`. No memory is allocated.
+ * 
+ * NOTE: Keys added while walking may or may not be returned.
+*/
+static void ini_key_iter_init(struct ini_key_iter *iter,
+                              struct ini_map *section)
+{
+    memset(iter, 0, sizeof *iter);
+    iter->next = section ? section->first : NULL;
+}
+
+/**
+ * Moves `iter` to the next key and returns true, or returns false if
+ * there are no more keys.
+*/
+static bool ini_key_iter_next(struct ini_key_iter *iter)
+{
+    struct ini_map_entry *entry = iter->next;
+
+    if (entry == NULL)
+        return false;
+
+    iter->entry = entry;
+    iter->next = entry->next;
+    iter->key = entry->key;
+    iter->size = entry->size;
+    iter->value = (const char*) entry->value;
+    return true;
+}
+
+/**
+ * Prepares `iter` to walk the sections of `ini` in insertion order
+ * with `ini_section_iter_next`. No memory is allocated.
+ * 
+ * Example:
+ * 
+ *     struct ini_section_iter sections;
+ *     struct ini_key_iter keys;
+ * 
+ *     ini_section_iter_init(&sections, ini);
+ * 
+ *     while (ini_section_iter_next(&sections)) {
+ *         ini_key_iter_init(&keys, sections.section);
+ * 
+ *         while (ini_key_iter_next(&keys))
+ *             printf("[%s] %s\n", sections.name, keys.key);
+ *     }
+*/
+static void ini_section_iter_init(struct ini_section_iter *iter, ini_t ini)
+{
+    memset(iter, 0, sizeof *iter);
+    iter->next = ini ? ini->first : NULL;
+}
+
+/**
+ * Moves `iter` to the next section and returns true, or returns false
+ * if there are no more sections.
+*/
+static bool ini_section_iter_next(struct ini_section_iter *iter)
+{
+    struct ini_map_entry *entry = iter->next;
+
+    if (entry == NULL)
+        return false;
+
+    iter->entry = entry;
+    iter->next = entry->next;
+    iter->name = entry->key;
+    iter->size = entry->size;
+    iter->section = (struct ini_map*) entry->value;
+    return true;
+}
+
+/**
+ * Frees memory for `map`. Maps that live in an arena are released
+ * together with the arena.
+*/
+static void ini_map_free(struct ini_map *map)
+{
+    struct ini_key_iter iter;
+
+    if (map != NULL && map->arena == NULL && map->slots) {
+        ini_key_iter_init(&iter, map);
+
+        /* The iterator has already moved past the entry it returned */
+        while (ini_key_iter_next(&iter)) {
+            ini_map_entry_release(map, iter.entry);
+            ini_map_release(map, iter.entry);
+        }
+
+        ini_map_release(map, map->slots);
+        ini_map_release(map, map);
+    }
+}
+
+/**
+ * Frees a section of the table of sections `map`.
+*/
+static void ini_map_free_section(struct ini_map *map, void *ptr)
+{
+    (void) map;
+    ini_map_free((struct ini_map*) ptr);
+}
+
+/**
+ * Creates a new ini_t object, which is a data structure for working
+ * with INI files.
+*/
+static ini_t ini_new(void) {
+    return ini_map_new(ini_map_free_section);
+}
+
+/**
+ * Same as `ini_new`, but all memory of the object is allocated with
+ * `allocator`, which must stay alive until `ini_free`. If `allocator`
+ * is NULL, INI_DEFAULT_ALLOCATOR is used.
+*/
+static ini_t ini_new_with(const struct ini_allocator *allocator)
+{
+    return ini_map_new_in(NULL, allocator, ini_map_free_section);
+}
+
+/**
+ * Same as `ini_new_arena`, but the blocks of the arena are allocated
+ * with `allocator`, which must stay alive until `ini_free`. If
+ * `allocator` is NULL, INI_DEFAULT_ALLOCATOR is used.
+*/
+static ini_t
+ini_new_arena_with(size_t size_hint, const struct ini_allocator *allocator)
+{
+    struct ini_arena *arena = ini_arena_new(size_hint, allocator);
+    ini_t ini = NULL;
+
+    if (arena != NULL) {
+        ini = ini_map_new_in(arena, allocator, NULL);
+
+        if (ini == NULL)
+            ini_arena_free(arena);
+    }
+
+    return ini;
+}
+
+/**
+ * Creates a new arena-backed ini_t object. All sections, keys and
+ * values are allocated in a few large blocks, the first of which holds
+ * at least `size_hint` bytes (0 selects `INI_ARENA_BLOCK_SIZE`), and
+ * `ini_free` releases them in one go.
+ * 
+ * NOTE: Overwritten values are not reclaimed until `ini_free`.
+*/
+static ini_t ini_new_arena(size_t size_hint)
+{
+    return ini_new_arena_with(size_hint, NULL);
+}
+
+#define ini_crit_is_node(p)                 (((uintptr_t) (p)) & 1)
+
+#define ini_crit_node_of(p)                                                 \
+    ((struct ini_crit_node*) ((uintptr_t) (p) - 1))
+
+#define ini_crit_section(entry)                                             \
+    ((struct ini_map*) (entry)->value)
+
+/**
+ * Returns the byte `i` of the first `size` characters of `str`, or 0
+ * past the end, so that a name sorts before the names it prefixes.
+*/
+static unsigned char ini_crit_byte(const char *str, size_t size, size_t i)
+{
+    return (i < size) ? (unsigned char) str[i] : 0;
+}
+
+/**
+ * Returns the child of `node` on the side of the name `str`.
+*/
+static void *ini_crit_child(const struct ini_crit_node *node,
+                            const char *str, size_t size)
+{
+    unsigned char c = ini_crit_byte(str, size, node->byte);
+    return node->child[(1 + (node->otherbits | c)) >> 8];
+}
+
+/**
+ * Returns the first (`side` 0) or the last (`side` 1) section entry
+ * below `p` in sorted order.
+*/
+static struct ini_map_entry *ini_crit_edge(void *p, int side)
+{
+    while (ini_crit_is_node(p))
+        p = ini_crit_node_of(p)->child[side];
+
+    return (struct ini_map_entry*) p;
+}
+
+/**
+ * Returns the section entry of the tree `root` that shares the longest
+ * path with the first `size` characters of `str`.
+*/
+static struct ini_map_entry *
+ini_crit_best(void *root, const char *str, size_t size)
+{
+    void *p = root;
+
+    while (ini_crit_is_node(p))
+        p = ini_crit_child(ini_crit_node_of(p), str, size);
+
+    return (struct ini_map_entry*) p;
+}
+
+/**
+ * Finds the first bit in which the first `size` characters of `str`
+ * differ from the name of `entry`. Stores its byte in `byte` and the
+ * mask with all other bits set in `otherbits`, and returns the side of
+ * `entry`, or -1 if the names are the same.
+*/
+static int ini_crit_diff(const struct ini_map_entry *entry, const char *str,
+                         size_t size, size_t *byte, unsigned char *otherbits)
+{
+    size_t i, end = (size > entry->size) ? size : entry->size;
+    unsigned x = 0, c = 0;
+
+    for (i = 0; i < end; ++i) {
+        c = ini_crit_byte(entry->key, entry->size, i);
+        x = c ^ ini_crit_byte(str, size, i);
+
+        if (x != 0)
+            break;
+    }
+
+    if (x == 0)
+        return -1;
+
+    /* Keeping only the highest differing bit */
+    x |= x >> 1;
+    x |= x >> 2;
+    x |= x >> 4;
+
+    *byte = i;
+    *otherbits = (unsigned char) ((x & ~(x >> 1)) ^ 255);
+    return (int) ((1 + (*otherbits | c)) >> 8);
+}
+
+/**
+ * Returns the place in the tree at `root` where the subtree of the
+ * names that have the bit of `byte` and `otherbits` in common with
+ * `str` hangs.
+*/
+static void **ini_crit_place(void **root, const char *str, size_t size,
+                             size_t byte, unsigned char otherbits)
+{
+    struct ini_crit_node *node;
+    void **where = root;
+
+    while (ini_crit_is_node(*where)) {
+        node = ini_crit_node_of(*where);
+
+        if (node->byte > byte
+            || (node->byte == byte && node->otherbits > otherbits))
+        {
+            break;
+        }
+
+        where = &node->child[(1 + (node->otherbits
+                                   | ini_crit_byte(str, size, node->byte)))
+                             >> 8];
+    }
+
+    return where;
+}
+
+/**
+ * Adds the section `entry` of `ini` to its crit-bit tree and links it
+ * between its neighbours in sorted order. The node that joins it to
+ * the tree is the one inside its section.
+*/
+static void ini_index_insert(ini_t ini, struct ini_map_entry *entry)
+{
+    struct ini_map *section = ini_crit_section(entry);
+    struct ini_map_entry *neighbour;
+    struct ini_crit_node *node = &section->node;
+    unsigned char otherbits;
+    void **where;
+    size_t byte;
+    int side;
+
+    section->sorted_prev = section->sorted_next = NULL;
+
+    if (ini->index == NULL) {
+        ini->index = entry;
+        return;
+    }
+
+    side = ini_crit_diff(ini_crit_best(ini->index, entry->key, entry->size),
+                         entry->key, entry->size, &byte, &otherbits);
+
+    if (side < 0)
+        return;
+
+    where = ini_crit_place(&ini->index, entry->key, entry->size, byte,
+                           otherbits);
+
+    node->byte = byte;
+    node->otherbits = otherbits;
+    node->child[side] = *where;
+    node->child[1 - side] = entry;
+
+    /* The new name comes right before or right after the old subtree */
+    if (side == 1) {
+        neighbour = ini_crit_edge(*where, 0);
+        section->sorted_prev = ini_crit_section(neighbour)->sorted_prev;
+        section->sorted_next = neighbour;
+        ini_crit_section(neighbour)->sorted_prev = entry;
+
+        if (section->sorted_prev != NULL)
+            ini_crit_section(section->sorted_prev)->sorted_next = entry;
+    }
+    else {
+        neighbour = ini_crit_edge(*where, 1);
+        section->sorted_next = ini_crit_section(neighbour)->sorted_next;
+        section->sorted_prev = neighbour;
+        ini_crit_section(neighbour)->sorted_next = entry;
+
+        if (section->sorted_next != NULL)
+            ini_crit_section(section->sorted_next)->sorted_prev = entry;
+    }
+
+    *where = (void*) ((uintptr_t) node | 1);
+}
+
+/**
+ * Builds the crit-bit tree of the sections of `ini` unless it is
+ * already there. The tree is only built by the first query, so parsing
+ * doesn't pay for it, and from then on sections are added to it as
+ * they are created.
+*/
+static void ini_index_build(ini_t ini)
+{
+    struct ini_map_entry *entry;
+
+    if (ini->index != NULL)
+        return;
+
+    for (entry = ini->first; entry != NULL; entry = entry->next) {
+        if (entry->value != NULL)
+            ini_index_insert(ini, entry);
+    }
+}
+
+/**
+ * Returns the first section of `ini` whose name isn't less than the
+ * first `size` characters of `str`, or NULL if there is none.
+*/
+static struct ini_map_entry *
+ini_index_lower_bound(ini_t ini, const char *str, size_t size)
+{
+    struct ini_map_entry *best;
+    unsigned char otherbits;
+    void **where;
+    size_t byte;
+    int side;
+
+    if (ini == NULL || ini->index == NULL)
+        return NULL;
+
+    best = ini_crit_best(ini->index, str, size);
+    side = ini_crit_diff(best, str, size, &byte, &otherbits);
+
+    if (side < 0)
+        return best;
+
+    where = ini_crit_place(&ini->index, str, size, byte, otherbits);
+
+    /* All names below `where` are greater than `str`, or all are less */
+    if (side == 1)
+        return ini_crit_edge(*where, 0);
+
+    return ini_crit_section(ini_crit_edge(*where, 1))->sorted_next;
+}
+
+/**
+ * Returns the section named by the first `size` characters of `name`,
+ * creating it if it doesn't exist yet. See `ini_map_entry_new` for the
+ * meaning of `borrow`. Returns NULL on error.
+*/
+static struct ini_map *
+ini_section_insert(ini_t ini, const char *name, size_t size, bool borrow)
+{
+    struct ini_map *section = (struct ini_map*)
+        ini_map_get_n(ini, name, size);
+
+    if (section == NULL) {
+        section = ini_map_new_in(ini->arena, ini->allocator,
+                                 ini->arena ? NULL : ini_map_free_string);
+
+        if (section == NULL)
+            return NULL;
+
+        if (!ini_map_insert(ini, name, size, section, borrow)) {
+            ini_map_free(section);
+            return NULL;
+        }
+
+        /* New entries are linked at the end */
+        if (ini->index != NULL)
+            ini_index_insert(ini, ini->last);
+    }
+
+    return section;
+}
+
+/**
+ * Returns the section named by the first `size` characters of `name`,
+ * creating it if it doesn't exist yet. Returns NULL on error.
+*/
+static struct ini_map *
+ini_section_n(ini_t ini, const char *name, size_t size)
+{
+    return ini_section_insert(ini, name, size, false);
+}
+
+/**
+ * Returns the section `name` of `ini`, creating it if it doesn't
+ * exist yet. Returns NULL on error.
+*/
+static struct ini_map *ini_section(ini_t ini, const char *name)
+{
+    return ini_section_n(ini, name, strlen(name));
+}
+
+/**
+ * Prepares `iter` to walk the sections of `ini` whose names start with
+ * `prefix`, in the byte order of their names, with
+ * `ini_sorted_iter_next`. The sections are found in the crit-bit tree
+ * of the names, so the cost depends on the number of matches and the
+ * length of `prefix`, but not on the number of sections. The tree is
+ * built by the first query on `ini`.
+ * 
+ * Example:
+ * 
+ *     struct ini_sorted_iter iter;
+ * 
+ *     ini_sections_with_prefix(&iter, ini, "pool.db.");
+ * 
+ *     while (ini_sorted_iter_next(&iter))
+ *         printf("[%s]\n", iter.name);
+ * 
+ * NOTE: Sections added during the walk may be skipped.
+*/
+static void ini_sections_with_prefix(struct ini_sorted_iter *iter,
+                                     ini_t ini, const char *prefix)
+{
+    struct ini_map_entry *best;
+    struct ini_crit_node *node;
+    size_t size;
+    void *p, *top;
+
+    memset(iter, 0, sizeof *iter);
+
+    if (prefix == NULL)
+        prefix = "";
+
+    size = strlen(prefix);
+
+    if (ini == NULL)
+        return;
+
+    ini_index_build(ini);
+
+    if (ini->index == NULL)
+        return;
+
+    /* `top` hangs below the last node that tests a byte of the prefix */
+    for (p = top = ini->index; ini_crit_is_node(p);) {
+        node = ini_crit_node_of(p);
+        p = ini_crit_child(node, prefix, size);
+
+        if (node->byte < size)
+            top = p;
+    }
+
+    /* Either all names below `top` start with the prefix, or none */
+    best = (struct ini_map_entry*) p;
+
+    if (best->size < size || memcmp(best->key, prefix, size) != 0)
+        return;
+
+    iter->next = ini_crit_edge(top, 0);
+    iter->stop = ini_crit_section(ini_crit_edge(top, 1))->sorted_next;
+}
+
+/**
+ * Prepares `iter` to walk the sections of `ini` whose names are not
+ * less than `from` and less than `to`, in the byte order of their
+ * names, with `ini_sorted_iter_next`. A NULL bound is open, so
+ * `ini_sections_in_range(&iter, ini, NULL, NULL)` walks all sections.
+*/
+static void ini_sections_in_range(struct ini_sorted_iter *iter, ini_t ini,
+                                  const char *from, const char *to)
+{
+    memset(iter, 0, sizeof *iter);
+
+    if (ini == NULL)
+        return;
+
+    ini_index_build(ini);
+
+    if (ini->index == NULL)
+        return;
+
+    if (from != NULL && to != NULL && strcmp(from, to) >= 0)
+        return;
+
+    if (from != NULL)
+        iter->next = ini_index_lower_bound(ini, from, strlen(from));
+    else
+        iter->next = ini_crit_edge(ini->index, 0);
+
+    if (to != NULL)
+        iter->stop = ini_index_lower_bound(ini, to, strlen(to));
+}
+
+/**
+ * Moves `iter` to the next section and returns true, or returns false
+ * if there are no more sections.
+*/
+static bool ini_sorted_iter_next(struct ini_sorted_iter *iter)
+{
+    struct ini_map_entry *entry = iter->next;
+
+    if (entry == NULL || entry == iter->stop)
+        return false;
+
+    iter->entry = entry;
+    iter->next = ini_crit_section(entry)->sorted_next;
+    iter->name = entry->key;
+    iter->size = entry->size;
+    iter->section = ini_crit_section(entry);
+    return true;
+}
+
+/**
+ * Retrieves a string from the specified section in `ini` by key.
+ * 
+ * Returns the value of the key `key` in the `section`, otherwise, if,
+ * for example, the key does not exist, returns the value `def`.
+ * 
+ * If `section` is NULL, then the default `INI_DEFAULT_SECTION_NAME`
+ * constant will be used.
+*/
+static const char*
+ini_get(ini_t ini, const char *section, const char *key, const char *def)
+{
+    struct ini_map *_section;
+    const char *section_name = section ? section : INI_DEFAULT_SECTION_NAME;
+    const char *value = NULL;
+
+    if (ini != NULL && key != NULL && ini->size > 0) {
+        _section = (struct ini_map*) ini_map_get(ini, section_name);
+
+        if (_section != NULL)
+            value = (const char *) ini_map_get(_section, key);
+    }
+
+    return (value != NULL) ? value : def;
+}
+
+/**
+ * Associates a string with a key in the specified section in `ini`.
+ * 
+ * If `section` is NULL, then the default `INI_DEFAULT_SECTION_NAME`
+ * constant will be used.
+ * 
+ * NOTE: You can also assign NULL to `value` to make the value not
+ * equal to anything.
+*/
+static void
+ini_set(ini_t ini, const char *section, const char *key, const char *value)
+{
+    struct ini_map *_section;
+    const char *section_name = section ? section : INI_DEFAULT_SECTION_NAME;
+
+    if (ini != NULL && key != NULL) {
+        _section = ini_section(ini, section_name);
+
+        if (_section != NULL)
+            ini_map_insert_string(_section, key, strlen(key), value,
+                                  value ? strlen(value) : 0);
+    }
+}
+
+/**
+ * Same as `ini_set`, but for the first `section_size`, `key_size` and
+ * `value_size` characters of `section`, `key` and `value`, which don't
+ * have to end with `\0`. `section` must not be NULL.
+*/
+static void ini_set_n(ini_t ini, const char *section, size_t section_size,
+                      const char *key, size_t key_size, const char *value,
+                      size_t value_size)
+{
+    struct ini_map *_section;
+
+    if (ini != NULL && section != NULL && key != NULL) {
+        _section = ini_section_n(ini, section, section_size);
+
+        if (_section != NULL)
+            ini_map_insert_string(_section, key, key_size, value, value_size);
+    }
+}
+
+/**
+ * Same as `ini_lookup`, but for the first `section_size` and `key_size`
+ * characters of `section` and `key`, whose hashes computed by
+ * `ini_hash` are `section_hash` and `key_hash`. This lets constant
+ * names be hashed at compile time. `section` must not be NULL.
+*/
+static ini_handle_t
+ini_lookup_hashed(ini_t ini, const char *section, size_t section_size,
+                  uint64_t section_hash, const char *key, size_t key_size,
+                  uint64_t key_hash)
+{
+    struct ini_map_entry *entry;
+
+    if (ini == NULL || section == NULL || key == NULL || ini->size == 0)
+        return NULL;
+
+    entry = ini_map_find(ini, section_hash, section, section_size);
+
+    if (entry == NULL)
+        return NULL;
+
+    return ini_map_find((struct ini_map*) entry->value, key_hash, key,
+                        key_size);
+}
+
+/**
+ * Resolves the `key` of the specified section in `ini` into a handle
+ * that can be read with `ini_get_h`. Returns NULL if the key does not
+ * exist.
+ * 
+ * The handle stays valid until `ini` is freed, and `ini_set` on the
+ * same key updates the value seen through it.
+ * 
+ * If `section` is NULL, then the default `INI_DEFAULT_SECTION_NAME`
+ * constant will be used.
+*/
+static ini_handle_t
+ini_lookup(ini_t ini, const char *section, const char *key)
+{
+    const char *section_name = section ? section : INI_DEFAULT_SECTION_NAME;
+    size_t section_size, key_size;
+
+    if (ini == NULL || key == NULL || ini->size == 0)
+        return NULL;
+
+    section_size = strlen(section_name);
+    key_size = strlen(key);
+
+    return ini_lookup_hashed(ini, section_name, section_size,
+                             ini_hash(section_name, section_size), key,
+                             key_size, ini_hash(key, key_size));
+}
+
+/**
+ * Returns the value of the key resolved into `handle`, otherwise, if
+ * `handle` is NULL or the key has no value, returns the value `def`.
+*/
+static const char *ini_get_h(ini_handle_t handle, const char *def)
+{
+    const char *value = handle ? (const char*) handle->value : NULL;
+    return (value != NULL) ? value : def;
+}
+
+/**
+ * Checks that `end`, where the conversion of `str` stopped, is
+ * followed by nothing but whitespace.
+*/
+static enum ini_status ini_convert_end(const char *str, const char *end)
+{
+    if (end == str)
+        return INI_ERROR_INVALID;
+
+    while (ini_isspace(*end))
+        ++end;
+
+    return (*end == '\0') ? INI_OK : INI_ERROR_INVALID;
+}
+
+/**
+ * Converts `str` to a decimal or, with the `0x` prefix, hexadecimal
+ * integer.
+*/
+static enum ini_status ini_convert_int(const char *str, union ini_number *out)
+{
+    const char *p = str;
+    char *end;
+
+    while (ini_isspace(*p))
+        ++p;
+
+    if (*p == '+' || *p == '-')
+        ++p;
+
+    errno = 0;
+    out->i = strtoll(str, &end, (p[0] == '0' && (p[1] | 0x20) == 'x') ? 16
+                                                                       : 10);
+
+    if (errno == ERANGE)
+        return INI_ERROR_RANGE;
+
+    return ini_convert_end(str, end);
+}
+
+static enum ini_status
+ini_convert_double(const char *str, union ini_number *out)
+{
+    char *end;
+
+    errno = 0;
+    out->d = strtod(str, &end);
+
+    if (errno == ERANGE)
+        return INI_ERROR_RANGE;
+
+    return ini_convert_end(str, end);
+}
+
+/**
+ * Converts `str`, which is one of `true`, `yes`, `on` and `1`, or one
+ * of `false`, `no`, `off` and `0`, in any case, to a boolean.
+*/
+static enum ini_status ini_convert_bool(const char *str, union ini_number *out)
+{
+    static const char *const names[] = {
+        "false", "true", "no", "yes", "off", "on", "0", "1"
+    };
+    size_t size, i, j;
+
+    while (ini_isspace(*str))
+        ++str;
+
+    for (size = strlen(str); size > 0 && ini_isspace(str[size - 1]); --size);
+
+    for (i = 0; i < sizeof names / sizeof *names; ++i) {
+        if (strlen(names[i]) != size)
+            continue;
+
+        for (j = 0; j < size && tolower((unsigned char) str[j]) == names[i][j];
+             ++j);
+
+        if (j == size) {
+            out->b = (i & 1) != 0;
+            return INI_OK;
+        }
+    }
+
+    return INI_ERROR_INVALID;
+}
+
+/**
+ * Converts `str`, a decimal number of bytes with an optional `k`, `M`,
+ * `G` or `T` suffix in any case, which multiply it by a power of 1024,
+ * to a size.
+*/
+static enum ini_status ini_convert_size(const char *str, union ini_number *out)
+{
+    unsigned long long size;
+    const char *p = str;
+    unsigned shift = 0;
+    char *end;
+
+    while (ini_isspace(*p))
+        ++p;
+
+    /* strtoull would accept a sign */
+    if (!isdigit((unsigned char) *p))
+        return INI_ERROR_INVALID;
+
+    errno = 0;
+    size = strtoull(p, &end, 10);
+
+    if (errno == ERANGE)
+        return INI_ERROR_RANGE;
+
+    switch (*end | 0x20) {
+    case 'k': shift = 10; ++end; break;
+    case 'm': shift = 20; ++end; break;
+    case 'g': shift = 30; ++end; break;
+    case 't': shift = 40; ++end; break;
+    }
+
+    if (ini_convert_end(p, end) != INI_OK)
+        return INI_ERROR_INVALID;
+
+    if (size > (unsigned long long) SIZE_MAX >> shift)
+        return INI_ERROR_RANGE;
+
+    out->size = (size_t) size << shift;
+    return INI_OK;
+}
+
+/**
+ * Converts `value` to `type` without caching, see `ini_get_typed_h`.
+*/
+static enum ini_status
+ini_convert_typed(const char *value, enum ini_type type,
+                  union ini_number *out)
+{
+    switch (type) {
+    case INI_TYPE_INT:
+        return ini_convert_int(value, out);
+    case INI_TYPE_DOUBLE:
+        return ini_convert_double(value, out);
+    case INI_TYPE_BOOL:
+        return ini_convert_bool(value, out);
+    case INI_TYPE_SIZE:
+        return ini_convert_size(value, out);
+    default:
+        return INI_ERROR_INVALID;
+    }
+}
+
+/**
+ * Converts the value of the key resolved into `handle` to `type`, and
+ * stores the result in `out` on success. The first conversion of the
+ * value is cached in the entry of the key until its value is changed
+ * with `ini_set`; conversions to other types are made on every call.
+ * 
+ * The cache is claimed with a compare-and-swap and published with a
+ * release store, so any number of threads may read the same `ini_t`
+ * with the typed accessors while nobody changes it. This needs the
+ * GCC atomic builtins; with INI_NO_THREADS, or on other compilers, the
+ * cache is written with plain stores and readers must not overlap.
+*/
+static enum ini_status
+ini_get_typed_h(ini_handle_t handle, enum ini_type type,
+                union ini_number *out)
+{
+    struct ini_map_entry *entry = (struct ini_map_entry*) handle;
+    enum ini_status status;
+    unsigned char cached;
+
+    if (entry == NULL || entry->value == NULL)
+        return INI_ERROR_MISSING;
+
+    if (type == INI_TYPE_NONE || type > INI_TYPE_SIZE)
+        return INI_ERROR_INVALID;
+
+#ifdef INI_HAS_ATOMICS
+    cached = __atomic_load_n(&entry->cached_type, __ATOMIC_ACQUIRE);
+#else
+    cached = entry->cached_type;
+#endif /* INI_HAS_ATOMICS */
+
+    if (cached == type) {
+        if (entry->cached_status == INI_OK)
+            *out = entry->cached;
+
+        return (enum ini_status) entry->cached_status;
+    }
+
+    /* Cached as another type, or being cached by another thread */
+    if (cached != INI_TYPE_NONE)
+        return ini_convert_typed((const char*) entry->value, type, out);
+
+#ifdef INI_HAS_ATOMICS
+    if (!__atomic_compare_exchange_n(&entry->cached_type, &cached,
+                                     (unsigned char) INI_TYPE_BUSY, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        return ini_convert_typed((const char*) entry->value, type, out);
+    }
+#endif /* INI_HAS_ATOMICS */
+
+    status = ini_convert_typed((const char*) entry->value, type,
+                               &entry->cached);
+    entry->cached_status = (unsigned char) status;
+
+#ifdef INI_HAS_ATOMICS
+    __atomic_store_n(&entry->cached_type, (unsigned char) type,
+                     __ATOMIC_RELEASE);
+#else
+    entry->cached_type = (unsigned char) type;
+#endif /* INI_HAS_ATOMICS */
+
+    if (status == INI_OK)
+        *out = entry->cached;
+
+    return status;
+}
+
+/**
+ * Same as `ini_get_typed_h`, but for the key `key` in the `section`.
+*/
+static enum ini_status
+ini_get_typed(ini_t ini, const char *section, const char *key,
+              enum ini_type type, union ini_number *out)
+{
+    return ini_get_typed_h(ini_lookup(ini, section, key), type, out);
+}
+
+/**
+ * Retrieves an integer from the specified section in `ini` by key.
+ * Decimal and `0x`-prefixed hexadecimal values are accepted.
+ * 
+ * Stores the value in `value` and returns INI_OK, otherwise returns
+ * the error and leaves `value` unchanged. The conversion is made once
+ * and cached until the key is changed with `ini_set`.
+ * 
+ * NOTE: Any number of threads may call the typed accessors on the same
+ * `ini` at once, see `ini_get_typed_h`, as long as no thread changes
+ * it with `ini_set` or anything else at the same time.
+ * 
+ * If `section` is NULL, then the default `INI_DEFAULT_SECTION_NAME`
+ * constant will be used.
+*/
+static enum ini_status
+ini_get_int(ini_t ini, const char *section, const char *key, long long *value)
+{
+    union ini_number number;
+    enum ini_status status = ini_get_typed(ini, section, key, INI_TYPE_INT,
+                                           &number);
+
+    if (status == INI_OK && value != NULL)
+        *value = number.i;
+
+    return status;
+}
+
+/**
+ * Same as `ini_get_int`, with the same caching and rules for threads,
+ * but for floating-point values.
+*/
+static enum ini_status
+ini_get_double(ini_t ini, const char *section, const char *key, double *value)
+{
+    union ini_number number;
+    enum ini_status status = ini_get_typed(ini, section, key,
+                                           INI_TYPE_DOUBLE, &number);
+
+    if (status == INI_OK && value != NULL)
+        *value = number.d;
+
+    return status;
+}
+
+/**
+ * Same as `ini_get_int`, with the same caching and rules for threads,
+ * but for booleans: `true`, `yes`, `on` and `1`, or `false`, `no`,
+ * `off` and `0`, in any case.
+*/
+static enum ini_status
+ini_get_bool(ini_t ini, const char *section, const char *key, bool *value)
+{
+    union ini_number number;
+    enum ini_status status = ini_get_typed(ini, section, key, INI_TYPE_BOOL,
+                                           &number);
+
+    if (status == INI_OK && value != NULL)
+        *value = number.b;
+
+    return status;
+}
+
+/**
+ * Same as `ini_get_int`, with the same caching and rules for threads,
+ * but for sizes in bytes with an optional `k`, `M`, `G` or `T` suffix,
+ * so that `64k` is 65536.
+*/
+static enum ini_status
+ini_get_size(ini_t ini, const char *section, const char *key, size_t *value)
+{
+    union ini_number number;
+    enum ini_status status = ini_get_typed(ini, section, key, INI_TYPE_SIZE,
+                                           &number);
+
+    if (status == INI_OK && value != NULL)
+        *value = number.size;
+
+    return status;
+}
+
+/**
+ * Frees memory for `ini`
+*/
+static void ini_free(ini_t ini)
+{
+    if (ini != NULL) {
+        if (ini->arena != NULL)
+            ini_arena_free(ini->arena);
+        else
+            ini_map_free(ini);
+    }
+}
+
+/**
+ * Fills `out` with the shape of the table of `map` and returns the sum
+ * of the chain lengths of its keys.
+*/
+static size_t
+ini_map_collect_stats(const struct ini_map *map, struct ini_map_stats *out)
+{
+    size_t i, chain, total = 0;
+
+    memset(out, 0, sizeof *out);
+    out->size = map->size;
+    out->capacity = map->capacity;
+
+    for (i = 0; i < map->capacity; ++i) {
+        if (map->slots[i].entry == NULL)
+            continue;
+
+        chain = ini_map_distance(map->slots[i].hash, i, map->capacity) + 1;
+        total += chain;
+
+        if (chain > out->longest_chain)
+            out->longest_chain = chain;
+    }
+
+    if (map->capacity > 0)
+        out->load_factor = (double) map->size / map->capacity;
+
+    if (map->size > 0)
+        out->average_chain = (double) total / map->size;
+
+    INI_STATS(out->rehashes = map->counters.rehashes);
+    return total;
+}
+
+/**
+ * Adds the memory used by the table, entries and strings of `map` to
+ * `out`. Values are counted if they are strings that are not stored
+ * inside their entries.
+*/
+static void ini_map_collect_bytes(const struct ini_map *map,
+                                  struct ini_stats *out, bool values)
+{
+    struct ini_map_entry *cur;
+
+    out->slot_bytes += sizeof *map + map->capacity * sizeof *map->slots;
+
+    for (cur = map->first; cur != NULL; cur = cur->next) {
+        out->entry_bytes += sizeof *cur;
+        out->key_bytes += cur->size + 1;
+
+        if (values && cur->value != NULL && cur->value != cur->inline_value)
+            out->value_bytes += strlen((const char*) cur->value) + 1;
+    }
+}
+
+/**
+ * Fills `out` with the shape of the table of `section` in `ini`.
+ * Returns false if there is no such section.
+ *
+ * If `section` is NULL, then the default `INI_DEFAULT_SECTION_NAME`
+ * constant will be used.
+*/
+static bool ini_section_stats(ini_t ini, const char *section,
+                              struct ini_map_stats *out)
+{
+    struct ini_map *map;
+    const char *section_name = section ? section : INI_DEFAULT_SECTION_NAME;
+
+    if (ini == NULL || out == NULL)
+        return false;
+
+    map = (struct ini_map*) ini_map_get(ini, section_name);
+
+    if (map == NULL)
+        return false;
+
+    ini_map_collect_stats(map, out);
+    return true;
+}
+
+/**
+ * Fills `out` with the statistics of `ini`: the shapes of the hash
+ * tables, the memory used and, with INI_ENABLE_STATS, the numbers of
+ * rehashes and what has been parsed into `ini`. It walks all sections
+ * and keys, so it is meant for diagnostics, not for hot paths. Returns
+ * false if `ini` is NULL.
+ *
+ * NOTE: For `ini_parse_parallel`, `parse_time` is the sum of the
+ * times of all threads.
+*/
+static bool ini_stats(ini_t ini, struct ini_stats *out)
+{
+    struct ini_section_iter iter;
+    struct ini_map_stats section;
+    size_t chains = 0;
+
+    if (ini == NULL || out == NULL)
+        return false;
+
+    memset(out, 0, sizeof *out);
+    ini_map_collect_stats(ini, &out->sections);
+    ini_map_collect_bytes(ini, out, false);
+
+    ini_section_iter_init(&iter, ini);
+
+    while (ini_section_iter_next(&iter)) {
+        chains += ini_map_collect_stats(iter.section, &section);
+        ini_map_collect_bytes(iter.section, out, true);
+
+        out->keys.size += section.size;
+        out->keys.capacity += section.capacity;
+        out->keys.rehashes += section.rehashes;
+
+        if (section.longest_chain > out->keys.longest_chain) {
+            out->keys.longest_chain = section.longest_chain;
+            out->longest_chain_section = iter.name;
+        }
+    }
+
+    if (out->keys.capacity > 0)
+        out->keys.load_factor = (double) out->keys.size / out->keys.capacity;
+
+    if (out->keys.size > 0)
+        out->keys.average_chain = (double) chains / out->keys.size;
+
+    INI_STATS(out->lines = ini->counters.lines);
+    INI_STATS(out->bytes = ini->counters.bytes);
+    INI_STATS(out->parse_time = ini->counters.parse_time);
+    return true;
+}
+
+/**
+ * Returns the hash of all keys and values of the section `map`, which
+ * doesn't depend on their order. It is computed once and kept until
+ * the section is changed.
+*/
+static uint64_t ini_map_digest(struct ini_map *map)
+{
+    struct ini_map_entry *cur;
+    const char *value;
+    uint64_t digest = 0;
+
+    if (!map->digest_valid) {
+        for (cur = map->first; cur != NULL; cur = cur->next) {
+            value = (const char*) cur->value;
+
+            if (value != NULL)
+                digest += ini_wyhash(value, strlen(value), cur->hash);
+            else
+                digest += cur->hash ^ INI_WY_SECRET3;
+        }
+
+        map->digest = digest;
+        map->digest_valid = true;
+    }
+
+    return map->digest;
+}
+
+/**
+ * Returns the entry of `key` in `map`, which may be NULL.
+*/
+static struct ini_map_entry *
+ini_map_find_entry(struct ini_map *map, const struct ini_map_entry *key)
+{
+    if (map == NULL)
+        return NULL;
+
+    return ini_map_find(map, key->hash, key->key, key->size);
+}
+
+/**
+ * Reports every key of `section` as `change` to `callback`, or the
+ * section itself if it has no keys. Returns the number of changes.
+*/
+static size_t ini_diff_section(enum ini_change change,
+                               const struct ini_map_entry *section,
+                               ini_diff_callback callback, void *user)
+{
+    struct ini_map_entry *cur = ((struct ini_map*) section->value)->first;
+    size_t count = 0;
+
+    if (cur == NULL) {
+        callback(change, section->key, NULL, NULL, NULL, user);
+        return 1;
+    }
+
+    for (; cur != NULL; cur = cur->next, ++count) {
+        if (change == INI_CHANGE_ADDED)
+            callback(change, section->key, cur->key, NULL,
+                     (const char*) cur->value, user);
+        else
+            callback(change, section->key, cur->key,
+                     (const char*) cur->value, NULL, user);
+    }
+
+    return count;
+}
+
+/**
+ * Compares `old` with `fresh` and reports the keys that were added,
+ * removed or changed to `callback`, section by section. Sections with
+ * the same size and digest (see `ini_map_digest`) are skipped without
+ * looking at their keys. Returns the number of changes.
+*/
+static size_t ini_diff(ini_t old, ini_t fresh, ini_diff_callback callback,
+                       void *user)
+{
+    struct ini_map_entry *sec, *cur, *prev;
+    struct ini_map *old_sec, *new_sec;
+    const char *old_value, *new_value;
+    size_t count = 0;
+
+    if (old == NULL || fresh == NULL || callback == NULL)
+        return 0;
+
+    for (sec = fresh->first; sec != NULL; sec = sec->next) {
+        new_sec = (struct ini_map*) sec->value;
+        prev = ini_map_find_entry(old, sec);
+
+        if (prev == NULL) {
+            count += ini_diff_section(INI_CHANGE_ADDED, sec, callback, user);
+            continue;
+        }
+
+        old_sec = (struct ini_map*) prev->value;
+
+        if (old_sec->size == new_sec->size
+            && ini_map_digest(old_sec) == ini_map_digest(new_sec))
+        {
+            continue;
+        }
+
+        for (cur = new_sec->first; cur != NULL; cur = cur->next) {
+            new_value = (const char*) cur->value;
+
+            if ((prev = ini_map_find_entry(old_sec, cur)) == NULL) {
+                callback(INI_CHANGE_ADDED, sec->key, cur->key, NULL,
+                         new_value, user);
+                count++;
+                continue;
+            }
+
+            old_value = (const char*) prev->value;
+
+            if (old_value != new_value && (!old_value || !new_value
+                || strcmp(old_value, new_value) != 0))
+            {
+                callback(INI_CHANGE_CHANGED, sec->key, cur->key, old_value,
+                         new_value, user);
+                count++;
+            }
+        }
+
+        for (cur = old_sec->first; cur != NULL; cur = cur->next) {
+            if (ini_map_find_entry(new_sec, cur) == NULL) {
+                callback(INI_CHANGE_REMOVED, sec->key, cur->key,
+                         (const char*) cur->value, NULL, user);
+                count++;
+            }
+        }
+    }
+
+    for (sec = old->first; sec != NULL; sec = sec->next) {
+        if (ini_map_find_entry(fresh, sec) == NULL)
+            count += ini_diff_section(INI_CHANGE_REMOVED, sec, callback, user);
+    }
+
+    return count;
+}
+
+/**
+ * Returns the hash of the first `size` characters of `key` in the
+ * section with the hash `section_hash`, used by frozen snapshots.
+*/
+static uint64_t
+ini_frozen_hash(uint64_t section_hash, const char *key, size_t size)
+{
+    return ini_wyhash_mixed(key, size, section_hash);
+}
+
+/**
+ * Returns the slot of the key with the hash `hash` in the bucket with
+ * the displacement `displacement`.
+*/
+static uint32_t
+ini_frozen_slot(uint64_t hash, uint32_t displacement, uint32_t slot_count)
+{
+    return (uint32_t) (ini_mix(hash, displacement ^ INI_WY_SECRET2)
+                       % slot_count);
+}
+
+/**
+ * Returns the bucket of the key with the hash `hash`.
+*/
+static uint32_t ini_frozen_bucket(uint64_t hash, uint32_t bucket_count)
+{
+    return (uint32_t) (hash >> 32) % bucket_count;
+}
+
+#define ini_frozen_table(frozen, type, offset)                              \
+    ((const type*) ((const char*) (frozen) + (frozen)->offset))
+
+#define ini_frozen_string(frozen, offset)                                   \
+    ((const char*) (frozen) + (frozen)->strings + (offset))
+
+/**
+ * Places the keys with the hashes `hashes` into `slot_count` slots
+ * with the hash and displace scheme: the keys are split into buckets,
+ * and starting from the largest bucket, every bucket gets the first
+ * displacement that moves all of its keys into free slots. Stores the
+ * slot of every key in `slots` and the displacements in `buckets`.
+ * 
+ * Returns false on error, or if two keys can't be told apart.
+*/
+static bool ini_frozen_place(const uint64_t *hashes, uint32_t count,
+                             uint32_t *buckets, uint32_t bucket_count,
+                             uint32_t *slots, uint32_t slot_count)
+{
+    uint32_t *sizes = NULL, *order = NULL, *members = NULL;
+    unsigned char *taken = NULL;
+    uint32_t i, j, k, b, size, max_size = 0, displacement, used;
+    bool result = false;
+
+    sizes = (uint32_t*)
+        ini_callocate(NULL, (size_t) bucket_count + 1, sizeof *sizes);
+    order = (uint32_t*)
+        ini_callocate(NULL, (size_t) bucket_count + 1, sizeof *order);
+    members = (uint32_t*)
+        ini_callocate(NULL, (size_t) count + 1, sizeof *members);
+    taken = (unsigned char*) ini_callocate(NULL, slot_count, 1);
+
+    if (!sizes || !order || !members || !taken)
+        goto cleanup;
+
+    /* Grouping the keys by buckets: `sizes[b]` becomes the end of `b` */
+    for (i = 0; i < count; ++i)
+        sizes[ini_frozen_bucket(hashes[i], bucket_count) + 1]++;
+
+    for (b = 0; b < bucket_count; ++b) {
+        if (sizes[b + 1] > max_size)
+            max_size = sizes[b + 1];
+
+        sizes[b + 1] += sizes[b];
+    }
+
+    for (i = 0; i < count; ++i)
+        members[sizes[ini_frozen_bucket(hashes[i], bucket_count)]++] = i;
+
+    /* Sorting the non-empty buckets by size, largest first */
+    for (used = 0, size = max_size; size > 0; --size) {
+        for (b = 0; b < bucket_count; ++b) {
+            if (sizes[b] - (b ? sizes[b - 1] : 0) == size)
+                order[used++] = b;
+        }
+    }
+
+    for (b = 0; b < bucket_count; ++b)
+        buckets[b] = 0;
+
+    for (i = 0; i < used; ++i) {
+        b = order[i];
+        size = sizes[b] - (b ? sizes[b - 1] : 0);
+
+        for (displacement = 0; ; ++displacement) {
+            if (displacement == INI_FROZEN_MAX_DISPLACEMENT)
+                goto cleanup;
+
+            for (j = 0; j < size; ++j) {
+                k = members[sizes[b] - size + j];
+                slots[k] = ini_frozen_slot(hashes[k], displacement,
+                                           slot_count);
+
+                if (taken[slots[k]])
+                    break;
+
+                taken[slots[k]] = 1;
+            }
+
+            if (j == size)
+                break;
+
+            /* Giving back the slots taken by this attempt */
+            while (j-- > 0)
+                taken[slots[members[sizes[b] - size + j]]] = 0;
+        }
+
+        buckets[b] = displacement;
+    }
+
+    result = true;
+
+cleanup:
+    ini_deallocate(NULL, sizes);
+    ini_deallocate(NULL, order);
+    ini_deallocate(NULL, members);
+    ini_deallocate(NULL, taken);
+    return result;
+}
+
+/**
+ * Creates an immutable snapshot of `ini`: all sections, keys and
+ * values are copied into one contiguous block, and the keys are
+ * placed with a perfect hash, so that `ini_frozen_get` reads a single
+ * displacement and a single key before comparing strings.
+ * 
+ * The snapshot does not depend on `ini`, which may be changed or freed
+ * afterwards, and it is never modified, so it can be read from any
+ * number of threads without locking. Returns NULL on error.
+ * 
+ * WARNING: Don't forget to free memory with `ini_frozen_free`
+*/
+static ini_frozen_t ini_freeze(ini_t ini)
+{
+    struct ini_map_entry **sections = NULL, **keys;
+    struct ini_map *section;
+    struct ini_frozen *frozen = NULL;
+    struct ini_frozen_section *fsec;
+    struct ini_frozen_key *fkey;
+    uint64_t *hashes = NULL, section_hash;
+    uint32_t *slots = NULL, *order;
+    size_t section_count, key_count = 0, count, i, j, k = 0;
+    size_t strings = 0, offset, total;
+    struct ini_frozen header = {0};
+    char *str;
+
+    if (ini == NULL)
+        return NULL;
+
+    section_count = ini_map_enumerate(ini, &sections);
+
+    if (ini->size > 0 && section_count == 0)
+        return NULL;
+
+    for (i = 0; i < section_count; ++i) {
+        section = (struct ini_map*) sections[i]->value;
+        strings += sections[i]->size + 1;
+        key_count += section->size;
+
+        keys = NULL;
+
+        for (j = ini_map_enumerate(section, &keys); j-- > 0;) {
+            strings += keys[j]->size + 1;
+
+            if (keys[j]->value != NULL)
+                strings += strlen((const char*) keys[j]->value) + 1;
+        }
+
+        ini_deallocate(NULL, keys);
+    }
+
+    header.magic = INI_FROZEN_MAGIC;
+    header.version = INI_FROZEN_VERSION;
+    header.seed = INI_HASH_SEED;
+    header.section_count = (uint32_t) section_count;
+    header.key_count = (uint32_t) key_count;
+    header.bucket_count = (uint32_t) (key_count / INI_FROZEN_BUCKET_SIZE + 1);
+    header.slot_count = (uint32_t) (key_count + key_count / 4 + 1);
+
+    /* Every table starts at a multiple of 8 bytes */
+    offset = sizeof header;
+    header.slots = (uint32_t) offset;
+    offset += (size_t) header.slot_count * sizeof *fkey;
+    header.sections = (uint32_t) offset;
+    offset += section_count * sizeof *fsec;
+    header.buckets = (uint32_t) offset;
+    offset += ((size_t) header.bucket_count * sizeof(uint32_t) + 7) & ~7u;
+    header.order = (uint32_t) offset;
+    offset += (key_count * sizeof(uint32_t) + 7) & ~7u;
+    header.strings = (uint32_t) offset;
+    total = offset + strings;
+
+    /* Offsets are 32-bit */
+    if (total > UINT32_MAX || key_count >= INI_FROZEN_NONE)
+        goto cleanup;
+
+    header.size = total;
+
+    hashes = (uint64_t*) ini_callocate(NULL, key_count + 1, sizeof *hashes);
+    slots = (uint32_t*) ini_callocate(NULL, key_count + 1, sizeof *slots);
+    frozen = (struct ini_frozen*) ini_callocate(NULL, 1, total);
+
+    if (hashes == NULL || slots == NULL || frozen == NULL)
+        goto cleanup;
+
+    *frozen = header;
+    fkey = (struct ini_frozen_key*) ((char*) frozen + header.slots);
+    fsec = (struct ini_frozen_section*) ((char*) frozen + header.sections);
+    order = (uint32_t*) ((char*) frozen + header.order);
+    str = (char*) frozen + header.strings;
+    offset = 0;
+
+    for (i = 0; i < header.slot_count; ++i)
+        fkey[i].section = INI_FROZEN_NONE;
+
+    for (i = 0; i < section_count; ++i) {
+        section = (struct ini_map*) sections[i]->value;
+        section_hash = ini_hash(sections[i]->key, sections[i]->size);
+
+        keys = NULL;
+        count = ini_map_enumerate(section, &keys);
+
+        if (count != section->size) {
+            ini_deallocate(NULL, keys);
+            goto cleanup;
+        }
+
+        for (j = 0; j < count; ++j)
+            hashes[k + j] = ini_frozen_hash(section_hash, keys[j]->key,
+                                            keys[j]->size);
+
+        ini_deallocate(NULL, keys);
+        k += count;
+    }
+
+    if (!ini_frozen_place(hashes, (uint32_t) key_count,
+                          (uint32_t*) ((char*) frozen + header.buckets),
+                          header.bucket_count, slots, header.slot_count))
+    {
+        goto cleanup;
+    }
+
+    for (i = 0, k = 0; i < section_count; ++i) {
+        section = (struct ini_map*) sections[i]->value;
+
+        fsec[i].name = (uint32_t) offset;
+        fsec[i].size = (uint32_t) sections[i]->size;
+        fsec[i].first = (uint32_t) k;
+        fsec[i].count = (uint32_t) section->size;
+        memcpy(str + offset, sections[i]->key, sections[i]->size + 1);
+        offset += sections[i]->size + 1;
+
+        keys = NULL;
+        count = ini_map_enumerate(section, &keys);
+
+        for (j = 0; j < count; ++j, ++k) {
+            struct ini_frozen_key *cur = &fkey[slots[k]];
+
+            order[k] = slots[k];
+            cur->hash = hashes[k];
+            cur->section = (uint32_t) i;
+            cur->key = (uint32_t) offset;
+            cur->key_size = (uint32_t) keys[j]->size;
+            memcpy(str + offset, keys[j]->key, keys[j]->size + 1);
+            offset += keys[j]->size + 1;
+
+            if (keys[j]->value != NULL) {
+                cur->value = (uint32_t) offset;
+                cur->value_size = (uint32_t) strlen((char*) keys[j]->value);
+                memcpy(str + offset, keys[j]->value, cur->value_size + 1);
+                offset += cur->value_size + 1;
+            }
+            else
+                cur->value = INI_FROZEN_NONE;
+        }
+
+        ini_deallocate(NULL, keys);
+    }
+
+    ini_deallocate(NULL, sections);
+    ini_deallocate(NULL, hashes);
+    ini_deallocate(NULL, slots);
+    return frozen;
+
+cleanup:
+    ini_deallocate(NULL, sections);
+    ini_deallocate(NULL, hashes);
+    ini_deallocate(NULL, slots);
+    ini_deallocate(NULL, frozen);
+    return NULL;
+}
+
+/**
+ * Returns the key of the first `key_size` characters of `key` in the
+ * section named by the first `section_size` characters of `section`,
+ * or NULL if `frozen` does not contain it.
+*/
+static const struct ini_frozen_key *
+ini_frozen_find(ini_frozen_t frozen, const char *section, size_t section_size,
+                const char *key, size_t key_size)
+{
+    const struct ini_frozen_section *fsec;
+    const struct ini_frozen_key *fkey;
+    uint64_t hash;
+    uint32_t bucket;
+
+    if (frozen == NULL || frozen->key_count == 0)
+        return NULL;
+
+    hash = ini_frozen_hash(ini_hash(section, section_size), key, key_size);
+    bucket = ini_frozen_bucket(hash, frozen->bucket_count);
+    bucket = ini_frozen_table(frozen, uint32_t, buckets)[bucket];
+    fkey = ini_frozen_table(frozen, struct ini_frozen_key, slots)
+         + ini_frozen_slot(hash, bucket, frozen->slot_count);
+
+    if (fkey->section == INI_FROZEN_NONE || fkey->hash != hash
+        || fkey->key_size != key_size
+        || memcmp(ini_frozen_string(frozen, fkey->key), key, key_size) != 0)
+    {
+        return NULL;
+    }
+
+    fsec = ini_frozen_table(frozen, struct ini_frozen_section, sections)
+         + fkey->section;
+
+    if (fsec->size != section_size
+        || memcmp(ini_frozen_string(frozen, fsec->name), section,
+                  section_size) != 0)
+    {
+        return NULL;
+    }
+
+    return fkey;
+}
+
+/**
+ * Same as `ini_get`, but for a frozen snapshot.
+ * 
+ * Returns the value of the key `key` in the `section`, otherwise, if,
+ * for example, the key does not exist, returns the value `def`.
+ * 
+ * If `section` is NULL, then the default `INI_DEFAULT_SECTION_NAME`
+ * constant will be used.
+*/
+static const char *ini_frozen_get(ini_frozen_t frozen, const char *section,
+                                  const char *key, const char *def)
+{
+    const char *section_name = section ? section : INI_DEFAULT_SECTION_NAME;
+    const struct ini_frozen_key *fkey = NULL;
+
+    if (frozen != NULL && key != NULL) {
+        fkey = ini_frozen_find(frozen, section_name, strlen(section_name),
+                               key, strlen(key));
+    }
+
+    if (fkey == NULL || fkey->value == INI_FROZEN_NONE)
+        return def;
+
+    return ini_frozen_string(frozen, fkey->value);
+}
+
+/**
+ * Frees memory for `frozen`
+*/
+static void ini_frozen_free(ini_frozen_t frozen)
+{
+#ifdef INI_HAS_MMAP
+    if (frozen != NULL && (frozen->flags & INI_FROZEN_MAPPED)) {
+        munmap((void*) frozen, (size_t) frozen->size);
+        return;
+    }
+#endif /* INI_HAS_MMAP */
+
+    ini_deallocate(NULL, (void*) frozen);
+}
+
+/**
+ * Checks if the end of a line has been reached in the I/O stream.
+*/
+static bool ini_io_string_eof(struct ini_io *io)
+{
+    const char *p = (const char*) io->raw;
+    return (bool) ((io != NULL) ? (*p == '\0') : true);
+}
+
+/**
+ * Returns the next character from the I/O string stream.
+*/
+static int ini_io_string_getc(struct ini_io *io)
+{
+    int ch = EOF;
+    const char *p = (const char*) io->raw;
+
+    if (io == NULL) return ch;
+    if (!io->eof(io)) ch = *p++;
+    
+    io->raw = (void*) p;
+    io->peek = ch;
+    return ch;
+}
+
+/**
+ * Checks if the end of the file has been reached in the I/O stream.
+*/
+static bool ini_io_file_eof(struct ini_io *io)
+{
+    return (bool) ((io != NULL) ? feof((FILE*) io->raw) : true);
+}
+
+/**
+ * Returns the next character from the I/O file stream.
+*/
+static int ini_io_file_getc(struct ini_io *io)
+{
+    if (io->eof(io))
+        io->peek = EOF;
+    else
+        io->peek = fgetc((FILE*) io->raw);
+
+    return io->peek;
+}
+
+/**
+ * Writes the character ch to the I/O file stream.
+*/
+static void ini_io_file_putc(struct ini_io *io, int ch)
+{
+    if (io != NULL)
+        fputc(ch, (FILE*) io->raw);
+}
+
+/**
+ * Reads up to `n` bytes from the I/O string stream.
+*/
+static size_t ini_io_string_read(struct ini_io *io, char *buf, size_t n)
+{
+    const char *p = (const char*) io->raw;
+    const char *end = (const char*) memchr(p, '\0', n);
+    size_t size = end ? (size_t) (end - p) : n;
+
+    memcpy(buf, p, size);
+    io->raw = (void*) (p + size);
+    return size;
+}
+
+/**
+ * Reads up to `n` bytes from the I/O file stream.
+*/
+static size_t ini_io_file_read(struct ini_io *io, char *buf, size_t n)
+{
+    return fread(buf, 1, n, (FILE*) io->raw);
+}
+
+/**
+ * Writes `n` bytes to the I/O file stream.
+*/
+static void ini_io_file_write(struct ini_io *io, const char *buf, size_t n)
+{
+    fwrite(buf, 1, n, (FILE*) io->raw);
+}
+
+/**
+ * Reads up to `n` bytes from the I/O input stream. Streams that only
+ * provide `getc` and `eof` are read one character at a time.
+*/
+static size_t ini_io_read_block(struct ini_io *io, char *buf, size_t n)
+{
+    size_t size = 0;
+    int ch;
+
+    if (io->read != NULL)
+        return io->read(io, buf, n);
+
+    while (size < n && !io->eof(io)) {
+        if ((ch = io->getc(io)) == EOF)
+            break;
+
+        buf[size++] = (char) ch;
+    }
+
+    return size;
+}
+
+/**
+ * Writes `n` bytes to the I/O output stream. Streams that only
+ * provide `putc` are written one character at a time.
+*/
+static void ini_io_write_block(struct ini_io *io, const char *buf, size_t n)
+{
+    size_t i;
+
+    if (io->write != NULL)
+        io->write(io, buf, n);
+    else {
+        for (i = 0; i < n; ++i)
+            io->putc(io, buf[i]);
+    }
+}
+
+/**
+ * Reads a line from the I/O input stream and returns it. Returns NULL
+ * if the end of file has been reached or an error has occurred.
+*/
+static char *ini_io_read_line(struct ini_io *io)
+{
+    size_t size = 0;
+    size_t capacity = 0;
+    char *buffer = NULL;
+    char *block;
+
+    if (io != NULL && io->mode == INI_IO_MODE_READ) {
+        while (!io->eof(io)) {
+            if (io->getc(io) == '\n' || io->peek == EOF)
+                break;
+
+            if ((size + 1) >= capacity) {
+                capacity += 64;
+
+                block = (char*) ini_reallocate(NULL, buffer, capacity);
+
+                if (block)
+                    buffer = block;
+                else
+                    break;
+            }
+
+            buffer[size++] = io->peek;
+            buffer[size] = '\0';
+        }
+    }
+
+    return buffer;
+}
+
+/**
+ * Writes the string line to the output stream I/O.
+*/
+static void ini_io_write(struct ini_io *io, const char *line)
+{
+    if (line != NULL && io != NULL && io->mode == INI_IO_MODE_WRITE)
+        ini_io_write_block(io, line, strlen(line));
+}
+
+/**
+ * Returns the next line of the stream and stores its length, without
+ * the line break, in `size`. Returns NULL if the end of file has been
+ * reached or an error has occurred. The line stays valid until the
+ * next call.
+*/
+static const char *
+ini_line_reader_next(struct ini_line_reader *reader, size_t *size)
+{
+    char *line, *end, *block;
+    size_t rest;
+
+    for (;;) {
+        line = reader->buffer + reader->pos;
+        rest = reader->size - reader->pos;
+        end = (char*) memchr(line, '\n', rest);
+
+        if (end != NULL) {
+            *size = (size_t) (end - line);
+            reader->pos += *size + 1;
+            return line;
+        }
+
+        if (reader->eof) {
+            if (rest == 0)
+                return NULL;
+
+            *size = rest;
+            reader->pos = reader->size;
+            return line;
+        }
+
+        /* Move the incomplete line to the front and read more */
+        memmove(reader->buffer, line, rest);
+        reader->pos = 0;
+        reader->size = rest;
+
+        if (reader->capacity - rest < INI_IO_BUFFER_SIZE / 2) {
+            block = (char*) ini_reallocate(reader->allocator, reader->buffer,
+                                           reader->capacity * 2);
+
+            if (block == NULL)
+                return NULL;
+
+            reader->buffer = block;
+            reader->capacity *= 2;
+        }
+
+        rest = ini_io_read_block(reader->io, reader->buffer + reader->size,
+                                 reader->capacity - reader->size);
+
+        reader->size += rest;
+        reader->eof = (rest == 0);
+    }
+}
+
+/**
+ * Fills the character class table of the line scanner and resets the
+ * rest of it.
+*/
+static void ini_scanner_init(struct ini_scanner *scanner)
+{
+    const char *ch;
+
+    memset(scanner->classes, INI_CHAR_PLAIN, sizeof scanner->classes);
+
+    for (ch = INI_KEY_VALUE_SEPARATORS; *ch != '\0'; ++ch)
+        scanner->classes[(unsigned char) *ch] = INI_CHAR_SEPARATOR;
+
+    for (ch = INI_COMMENT_SYMBOLS; *ch != '\0'; ++ch)
+        scanner->classes[(unsigned char) *ch] = INI_CHAR_COMMENT;
+
+    scanner->classes[']'] = INI_CHAR_SECTION_END;
+    scanner->classes['\n'] = INI_CHAR_NEWLINE;
+    scanner->ready = true;
+    scanner->block = NULL;
+    scanner->mask = 0;
+#ifdef INI_ENABLE_STATS
+    scanner->lines = 0;
+    scanner->bytes = 0;
+#endif /* INI_ENABLE_STATS */
+}
+
+#if defined(INI_HAS_AVX2) || defined(INI_HAS_SSE2)
+
+#ifdef INI_HAS_AVX2
+#define INI_SCAN_WIDTH                      32
+#define ini_simd_t                          __m256i
+#define ini_simd_load(p)    _mm256_loadu_si256((const __m256i*) (p))
+#define ini_simd_eq(v, ch)  _mm256_cmpeq_epi8(v, _mm256_set1_epi8(ch))
+#define ini_simd_or(a, b)   _mm256_or_si256(a, b)
+#define ini_simd_mask(v)    ((uint32_t) _mm256_movemask_epi8(v))
+#else
+#define INI_SCAN_WIDTH                      16
+#define ini_simd_t                          __m128i
+#define ini_simd_load(p)    _mm_loadu_si128((const __m128i*) (p))
+#define ini_simd_eq(v, ch)  _mm_cmpeq_epi8(v, _mm_set1_epi8(ch))
+#define ini_simd_or(a, b)   _mm_or_si128(a, b)
+#define ini_simd_mask(v)    ((uint32_t) _mm_movemask_epi8(v))
+#endif /* INI_HAS_AVX2 */
+
+/**
+ * Returns a bit mask of the characters among the `INI_SCAN_WIDTH`
+ * bytes at `p` that the line scanner has to look at: line breaks,
+ * comment symbols, separators and `]`.
+*/
+static uint32_t ini_scan_mask(const char *p)
+{
+    const ini_simd_t block = ini_simd_load(p);
+    ini_simd_t found = ini_simd_eq(block, '\n');
+    size_t i;
+
+    found = ini_simd_or(found, ini_simd_eq(block, ']'));
+
+    for (i = 0; i < sizeof INI_COMMENT_SYMBOLS - 1; ++i) {
+        found = ini_simd_or(found,
+            ini_simd_eq(block, INI_COMMENT_SYMBOLS[i]));
+    }
+
+    for (i = 0; i < sizeof INI_KEY_VALUE_SEPARATORS - 1; ++i) {
+        found = ini_simd_or(found,
+            ini_simd_eq(block, INI_KEY_VALUE_SEPARATORS[i]));
+    }
+
+    return ini_simd_mask(found);
+}
+
+#endif /* INI_HAS_AVX2 || INI_HAS_SSE2 */
+
+/**
+ * Scans one line starting at `p` in a single pass, classifying line
+ * breaks, comment symbols, separators and `]`, and stores the token
+ * spans in `tokens`. `end` is the end of the input.
+ * 
+ * With SSE2 or AVX2 the input is classified `INI_SCAN_WIDTH` bytes at a
+ * time, and the bit mask of the last block is kept in `scanner` for the
+ * following lines. Set `scanner->block` to NULL before scanning another
+ * buffer.
+*/
+static void ini_scan_line(struct ini_scanner *scanner, const char *p,
+                          const char *end, struct ini_line_tokens *tokens)
+{
+    const char *separator = NULL;
+    const char *section_end = NULL;
+    unsigned char cls;
+#ifdef INI_SCAN_WIDTH
+    const char *block = scanner->block;
+    uint32_t mask;
+    int i;
+#endif /* INI_SCAN_WIDTH */
+
+    tokens->line = p;
+
+    while (p < end) {
+#ifdef INI_SCAN_WIDTH
+        if (block == NULL || p < block || p >= block + INI_SCAN_WIDTH) {
+            if (end - p < INI_SCAN_WIDTH)
+                goto scalar;
+
+            block = p;
+            scanner->block = block;
+            scanner->mask = ini_scan_mask(block);
+        }
+
+        mask = scanner->mask & (~(uint32_t) 0 << (p - block));
+
+        for (; mask != 0; mask &= mask - 1) {
+            i = __builtin_ctz(mask);
+            cls = scanner->classes[(unsigned char) block[i]];
+
+            if (cls == INI_CHAR_NEWLINE || cls == INI_CHAR_COMMENT) {
+                p = block + i;
+                goto found;
+            }
+
+            if (cls == INI_CHAR_SEPARATOR && separator == NULL)
+                separator = block + i;
+            else if (cls == INI_CHAR_SECTION_END && section_end == NULL)
+                section_end = block + i;
+        }
+
+        p = block + INI_SCAN_WIDTH;
+        continue;
+scalar:
+#endif /* INI_SCAN_WIDTH */
+
+        cls = scanner->classes[(unsigned char) *p];
+
+        if (cls == INI_CHAR_NEWLINE || cls == INI_CHAR_COMMENT)
+            goto found;
+
+        if (cls == INI_CHAR_SEPARATOR && separator == NULL)
+            separator = p;
+        else if (cls == INI_CHAR_SECTION_END && section_end == NULL)
+            section_end = p;
+
+        ++p;
+    }
+
+found:
+    tokens->size = (size_t) (p - tokens->line);
+    tokens->separator = separator ?
+        (size_t) (separator - tokens->line) : tokens->size;
+    tokens->section_end = section_end ?
+        (size_t) (section_end - tokens->line) : tokens->size;
+
+    /* Skip the rest of a comment */
+    if (p < end && *p != '\n')
+        p = (const char*) memchr(p, '\n', (size_t) (end - p));
+
+    tokens->next = (p != NULL && p < end) ? p + 1 : end;
+}
+
+/**
+ * Removes leading and trailing spaces from the `*str` span of `*size`
+ * characters by moving its bounds.
+*/
+static void ini_span_trim(const char **str, size_t *size)
+{
+    const char *first = *str;
+    const char *last = *str + *size;
+
+    while (first < last && ini_isspace(*first))
+        ++first;
+
+    while (last > first && ini_isspace(last[-1]))
+        --last;
+
+    *str = first;
+    *size = (size_t) (last - first);
+}
+
+/**
+ * Removes the quotes around the `*str` span of `*size` characters.
+ * A value such as `"payroll.dat"` is reduced to its contents up to the
+ * closing quote.
+*/
+static void ini_span_unquote(const char **str, size_t *size)
+{
+    const char *end;
+
+    if (*size > 1 && (*str)[0] == '"' && (*str)[1] != '"') {
+        end = (const char*) memchr(*str + 1, '"', *size - 1);
+
+        *size = end ? (size_t) (end - *str - 1) : *size - 1;
+        *str += 1;
+    }
+}
+
+/**
+ * Makes the section named `name[0..size)` current, creating it in the
+ * ini_t structure if needed.
+*/
+static void ini_parse_section_name(struct ini_parse_state *state,
+                                   const char *name, size_t size)
+{
+    struct ini_map *section;
+    bool borrow = (state->inplace_end != NULL && state->ini->arena);
+
+    /* The name is always followed by `]` */
+    if (borrow)
+        *(char*) (name + size) = '\0';
+
+    section = ini_section_insert(state->ini, name, size, borrow);
+
+    if (section != NULL)
+        state->cur_section = section;
+}
+
+/**
+ * Reports the line found by `ini_scan_line` to `handler`: a section
+ * line, a key-value line, whose key and value are trimmed and unquoted,
+ * and a comment, which starts with its comment symbol. Returns false if
+ * a callback stops the parsing.
+*/
+static bool ini_handle_tokens(const struct ini_handler *handler,
+                              const struct ini_line_tokens *tokens)
+{
+    const char *line = tokens->line;
+    const char *separator = line + tokens->separator;
+    const char *comment = line + tokens->size;
+    const char *comment_end = tokens->next;
+    const char *key, *value;
+    size_t size = tokens->size;
+    size_t key_size, value_size;
+
+    ini_span_trim(&line, &size);
+
+    if (size == 0)
+        ;
+    else if (tokens->separator == tokens->size) {
+        if (*line == '[' && tokens->section_end < tokens->size
+            && handler->on_section != NULL
+            && !handler->on_section(line + 1, (size_t) (tokens->line
+                + tokens->section_end - line - 1), handler->user))
+        {
+            return false;
+        }
+    }
+    else if (handler->on_kv != NULL) {
+        key = line;
+        key_size = (size_t) (separator - line);
+        value = separator + 1;
+        value_size = (size_t) (line + size - value);
+
+        ini_span_trim(&key, &key_size);
+        ini_span_trim(&value, &value_size);
+        ini_span_unquote(&value, &value_size);
+
+        if (!handler->on_kv(key, key_size, value, value_size, handler->user))
+            return false;
+    }
+
+    if (handler->on_comment != NULL && comment < comment_end
+        && *comment != '\n')
+    {
+        while (comment_end > comment && ini_isspace(comment_end[-1]))
+            --comment_end;
+
+        return handler->on_comment(comment, (size_t) (comment_end - comment),
+                                   handler->user);
+    }
+
+    return true;
+}
+
+/**
+ * `on_section` callback that makes the section current in the parse
+ * state `user`.
+*/
+static bool ini_build_section(const char *name, size_t size, void *user)
+{
+    ini_parse_section_name((struct ini_parse_state*) user, name, size);
+    return true;
+}
+
+/**
+ * `on_kv` callback that adds the key to the current section of the
+ * parse state `user`. Only the key and the value are copied into the
+ * ini_t structure, unless parsing in place.
+*/
+static bool ini_build_kv(const char *key, size_t key_size, const char *value,
+                         size_t value_size, void *user)
+{
+    struct ini_parse_state *state = (struct ini_parse_state*) user;
+    struct ini_map *section = state->cur_section;
+    struct ini_map_entry *entry;
+    bool borrow = (state->inplace_end != NULL && state->ini->arena);
+
+    if (value_size == 0)
+        return true;
+
+    if (!borrow) {
+        ini_map_insert_string(section, key, key_size, value, value_size);
+        return true;
+    }
+
+    /* The key is always followed by the separator */
+    *(char*) (key + key_size) = '\0';
+    entry = ini_map_upsert(section, ini_hash(key, key_size), key, key_size,
+                           true);
+
+    if (entry == NULL)
+        return true;
+
+    if (value + value_size < state->inplace_end) {
+        ((char*) value)[value_size] = '\0';
+        ini_map_entry_assign(section, entry, (char*) value);
+    }
+    else
+        ini_map_entry_assign_n(section, entry, value, value_size);
+
+    return true;
+}
+
+/**
+ * Returns the handler that builds the ini_t structure of `state`.
+*/
+static struct ini_handler ini_build_handler(struct ini_parse_state *state)
+{
+    struct ini_handler handler = {0};
+
+    handler.on_section = ini_build_section;
+    handler.on_kv = ini_build_kv;
+    handler.user = state;
+    return handler;
+}
+
+/**
+ * Parses one line from the token spans found by `ini_scan_line` and
+ * updates the parse state.
+*/
+static void ini_parse_tokens(struct ini_parse_state *state,
+                             const struct ini_line_tokens *tokens)
+{
+    struct ini_handler handler = ini_build_handler(state);
+    ini_handle_tokens(&handler, tokens);
+}
+
+/**
+ * Parses one raw line `line[0..size)` of the input, which doesn't have
+ * to end with `\0`, and updates the parse state.
+*/
+static void ini_parse_span(struct ini_parse_state *state,
+                           const char *line, size_t size)
+{
+    struct ini_line_tokens tokens;
+
+    if (!state->scanner.ready)
+        ini_scanner_init(&state->scanner);
+
+    state->scanner.block = NULL;
+    ini_scan_line(&state->scanner, line, line + size, &tokens);
+    ini_parse_tokens(state, &tokens);
+}
+
+/**
+ * The ini_parse_line_section function parses the line containing the
+ * section name and creates a new section in the ini_t structure.
+*/
+static void
+ini_parse_line_section(struct ini_parse_state *state, const char *line)
+{
+    const char *end;
+
+    if (line != NULL && *line == '[') {
+        end = strchr(line, ']');
+
+        if (end != NULL)
+            ini_parse_section_name(state, line + 1, end - line - 1);
+    }
+}
+
+/**
+ * The ini_parse_line function parses one line from the I/O stream and
+ * updates the parse state.
+*/
+static void ini_parse_line(struct ini_parse_state *state, const char *line)
+{
+    if (line != NULL)
+        ini_parse_span(state, line, strlen(line));
+}
+
+/**
+ * Reports every line of `size` bytes of `buf` to `handler`. Returns
+ * false if a callback stops the parsing.
+*/
+static bool ini_scan_buffer(struct ini_scanner *scanner, const char *buf,
+                            size_t size, const struct ini_handler *handler)
+{
+    struct ini_line_tokens tokens;
+    const char *end = buf + size;
+    const char *line;
+
+    scanner->block = NULL;
+
+    INI_STATS(scanner->bytes += size);
+
+    for (line = buf; line < end; line = tokens.next) {
+        ini_scan_line(scanner, line, end, &tokens);
+        INI_STATS(++scanner->lines);
+
+        if (!ini_handle_tokens(handler, &tokens))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Reports every line of the I/O stream to `handler`, reading it into
+ * a buffer from `allocator`. Returns false on error or if a callback
+ * stops the parsing.
+*/
+static bool ini_scan_io(struct ini_scanner *scanner, struct ini_io *io,
+                        const struct ini_handler *handler,
+                        const struct ini_allocator *allocator)
+{
+    struct ini_line_reader reader = {0};
+    struct ini_line_tokens tokens;
+    const char *line;
+    bool result = true;
+    size_t size;
+
+    reader.io = io;
+    reader.allocator = allocator;
+    reader.capacity = INI_IO_BUFFER_SIZE;
+    reader.buffer = (char*) ini_allocate(allocator, reader.capacity);
+
+    if (reader.buffer == NULL)
+        return false;
+
+    while (result && (line = ini_line_reader_next(&reader, &size)) != NULL) {
+        scanner->block = NULL;
+        ini_scan_line(scanner, line, line + size, &tokens);
+        INI_STATS(++scanner->lines);
+        INI_STATS(scanner->bytes += size);
+        result = ini_handle_tokens(handler, &tokens);
+    }
+
+    ini_deallocate(allocator, reader.buffer);
+    return result;
+}
+
+/**
+ * Prepares the parse state: creates `state->ini` unless it is already
+ * set and makes the DEFAULT section current. Returns false on error.
+*/
+static bool ini_parse_begin(struct ini_parse_state *state)
+{
+    if (state->ini == NULL)
+        state->ini = ini_new();
+
+    if (state->ini == NULL)
+        return false;
+
+    if (!state->scanner.ready)
+        ini_scanner_init(&state->scanner);
+
+    /* Add a DEFAULT section */
+    state->cur_section = ini_section(state->ini, INI_DEFAULT_SECTION_NAME);
+    return state->cur_section != NULL;
+}
+
+#ifdef INI_ENABLE_STATS
+/* Returns a monotonic time in seconds if there is one */
+static double ini_stats_clock(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif /* CLOCK_MONOTONIC */
+
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static void ini_parse_stats_begin(struct ini_parse_state *state)
+{
+    state->started.lines = state->scanner.lines;
+    state->started.bytes = state->scanner.bytes;
+    state->started.parse_time = ini_stats_clock();
+}
+
+/* Adds what was parsed since `ini_parse_stats_begin` to the counters */
+static void ini_parse_stats_end(struct ini_parse_state *state)
+{
+    struct ini_map_counters *counters = &state->ini->counters;
+    size_t lines = state->scanner.lines - state->started.lines;
+    size_t bytes = state->scanner.bytes - state->started.bytes;
+    double time = ini_stats_clock() - state->started.parse_time;
+
+    counters->lines += lines;
+    counters->bytes += bytes;
+    counters->parse_time += time;
+    INI_ON_PARSE(state->ini, lines, bytes, time);
+}
+#endif /* INI_ENABLE_STATS */
+
+/**
+ * The ini_parse function parses the I/O stream and creates an ini_t
+ * structure with configuration data.
+ * 
+ * If `state->ini` is not NULL, the data is added to it instead, which
+ * allows parsing into an arena-backed object from `ini_new_arena`.
+ * 
+ * The following fields of the I/O structure must not be NULL:
+ * - raw 
+ * - mode (should be INI_IO_MODE_READ)
+ * - read, or getc and eof
+*/
+static ini_t ini_parse(struct ini_io *io, struct ini_parse_state *state)
+{
+    struct ini_handler handler;
+
+    if (io == NULL || io->mode != INI_IO_MODE_READ)
+        return state->ini;
+
+    if (ini_parse_begin(state)) {
+        INI_STATS(ini_parse_stats_begin(state));
+        handler = ini_build_handler(state);
+        ini_scan_io(&state->scanner, io, &handler, state->ini->allocator);
+        INI_STATS(ini_parse_stats_end(state));
+    }
+
+    return state->ini;
+}
+
+/**
+ * Parses `size` bytes of the in-memory buffer `buf`, which doesn't have
+ * to end with `\0`, directly without copying lines. See `ini_parse`
+ * for the meaning of `state`.
+*/
+static ini_t ini_parse_buffer(const char *buf, size_t size,
+                              struct ini_parse_state *state)
+{
+    struct ini_handler handler;
+
+    if (buf != NULL && ini_parse_begin(state)) {
+        INI_STATS(ini_parse_stats_begin(state));
+        handler = ini_build_handler(state);
+        ini_scan_buffer(&state->scanner, buf, size, &handler);
+        INI_STATS(ini_parse_stats_end(state));
+    }
+
+    return state->ini;
+}
+
+/**
+ * Parses the I/O stream without building an ini_t structure, and
+ * calls `on_section` for every section line, `on_kv` for every
+ * key-value line and `on_comment` for every comment, in the order they
+ * occur. Any of the callbacks may be NULL. Keys and values are trimmed
+ * and unquoted, and values may be empty.
+ * 
+ * Memory use doesn't depend on the size of the input: lines are read
+ * into a buffer of INI_IO_BUFFER_SIZE bytes, which only grows for
+ * longer lines.
+ * 
+ * Returns true if the whole stream has been parsed, or false on error
+ * or if a callback returned false.
+*/
+static bool ini_parse_cb(struct ini_io *io, ini_section_callback on_section,
+                         ini_kv_callback on_kv, ini_comment_callback on_comment,
+                         void *user)
+{
+    struct ini_scanner scanner;
+    struct ini_handler handler;
+
+    if (io == NULL || io->mode != INI_IO_MODE_READ)
+        return false;
+
+    handler.on_section = on_section;
+    handler.on_kv = on_kv;
+    handler.on_comment = on_comment;
+    handler.user = user;
+
+    ini_scanner_init(&scanner);
+    return ini_scan_io(&scanner, io, &handler, NULL);
+}
+
+/**
+ * Same as `ini_parse_cb`, but for `size` bytes of the in-memory buffer
+ * `buf`, which doesn't have to end with `\0`. The spans point into
+ * `buf`.
+*/
+static bool ini_parse_buffer_cb(const char *buf, size_t size,
+                                ini_section_callback on_section,
+                                ini_kv_callback on_kv,
+                                ini_comment_callback on_comment, void *user)
+{
+    struct ini_scanner scanner;
+    struct ini_handler handler;
+
+    if (buf == NULL)
+        return false;
+
+    handler.on_section = on_section;
+    handler.on_kv = on_kv;
+    handler.on_comment = on_comment;
+    handler.user = user;
+
+    ini_scanner_init(&scanner);
+    return ini_scan_buffer(&scanner, buf, size, &handler);
+}
+
+#define ini_field_section(field)                                            \
+    ((field)->section ? (field)->section : INI_DEFAULT_SECTION_NAME)
+
+/**
+ * Frees the tables of `schema`.
+*/
+static void ini_schema_free(struct ini_schema *schema)
+{
+    if (schema != NULL) {
+        ini_deallocate(NULL, schema->hashes);
+        schema->hashes = schema->section_hashes = NULL;
+        schema->buckets = schema->slots = NULL;
+    }
+}
+
+/**
+ * Prepares `schema` for the `count` fields of `fields`, which must
+ * outlive it: hashes every section and key and places them with the
+ * hash and displace scheme of `ini_freeze`. This is done once, so
+ * that `ini_bind_buffer` only has to hash the keys of the input.
+ * 
+ * Returns false on error, or if a key is bound twice.
+ * 
+ * WARNING: Don't forget to free memory with `ini_schema_free`
+*/
+static bool ini_schema_init(struct ini_schema *schema,
+                            const struct ini_field *fields, size_t count)
+{
+    uint32_t *places = NULL;
+    const char *section;
+    size_t size, i;
+    bool result;
+
+    memset(schema, 0, sizeof *schema);
+
+    if (fields == NULL || count >= INI_FROZEN_NONE)
+        return false;
+
+    schema->fields = fields;
+    schema->count = (uint32_t) count;
+    schema->bucket_count = (uint32_t) (count / INI_FROZEN_BUCKET_SIZE + 1);
+    schema->slot_count = (uint32_t) (count + count / 4 + 1);
+
+    size = 2 * count * sizeof(uint64_t) + ((size_t) schema->bucket_count
+         + schema->slot_count) * sizeof(uint32_t);
+
+    schema->hashes = (uint64_t*) ini_allocate(NULL, size);
+    places = (uint32_t*) ini_allocate(NULL, (count + 1) * sizeof *places);
+
+    if (schema->hashes == NULL || places == NULL) {
+        ini_deallocate(NULL, places);
+        ini_schema_free(schema);
+        return false;
+    }
+
+    schema->section_hashes = schema->hashes + count;
+    schema->buckets = (uint32_t*) (schema->section_hashes + count);
+    schema->slots = schema->buckets + schema->bucket_count;
+
+    for (i = 0; i < count; ++i) {
+        section = ini_field_section(&fields[i]);
+        schema->section_hashes[i] = ini_hash(section, strlen(section));
+        schema->hashes[i] = ini_frozen_hash(schema->section_hashes[i],
+                                            fields[i].key,
+                                            strlen(fields[i].key));
+    }
+
+    result = ini_frozen_place(schema->hashes, schema->count,
+                              schema->buckets, schema->bucket_count,
+                              places, schema->slot_count);
+
+    if (result) {
+        for (i = 0; i < schema->slot_count; ++i)
+            schema->slots[i] = INI_FROZEN_NONE;
+
+        for (i = 0; i < count; ++i)
+            schema->slots[places[i]] = (uint32_t) i;
+    }
+    else
+        ini_schema_free(schema);
+
+    ini_deallocate(NULL, places);
+    return result;
+}
+
+/**
+ * Stores `value` in the signed integer of `size` bytes at `ptr`.
+*/
+static enum ini_status
+ini_field_store_int(void *ptr, size_t size, long long value)
+{
+    int8_t i8 = (int8_t) value;
+    int16_t i16 = (int16_t) value;
+    int32_t i32 = (int32_t) value;
+    int64_t i64 = (int64_t) value;
+    const void *src;
+    bool fits;
+
+    switch (size) {
+    case 1: src = &i8; fits = (i8 == value); break;
+    case 2: src = &i16; fits = (i16 == value); break;
+    case 4: src = &i32; fits = (i32 == value); break;
+    case 8: src = &i64; fits = true; break;
+    default: return INI_ERROR_INVALID;
+    }
+
+    if (!fits)
+        return INI_ERROR_RANGE;
+
+    memcpy(ptr, src, size);
+    return INI_OK;
+}
+
+/**
+ * Stores `value` in the unsigned integer of `size` bytes at `ptr`.
+*/
+static enum ini_status
+ini_field_store_uint(void *ptr, size_t size, unsigned long long value)
+{
+    uint8_t u8 = (uint8_t) value;
+    uint16_t u16 = (uint16_t) value;
+    uint32_t u32 = (uint32_t) value;
+    uint64_t u64 = (uint64_t) value;
+    const void *src;
+    bool fits;
+
+    switch (size) {
+    case 1: src = &u8; fits = (u8 == value); break;
+    case 2: src = &u16; fits = (u16 == value); break;
+    case 4: src = &u32; fits = (u32 == value); break;
+    case 8: src = &u64; fits = true; break;
+    default: return INI_ERROR_INVALID;
+    }
+
+    if (!fits)
+        return INI_ERROR_RANGE;
+
+    memcpy(ptr, src, size);
+    return INI_OK;
+}
+
+/**
+ * Converts the first `size` characters of `value` to the type of
+ * `field` and stores the result in its member of `out`. Numbers are
+ * converted from a copy on the stack, so nothing is allocated. The
+ * member is left unchanged on error.
+*/
+static enum ini_status ini_field_store(const struct ini_field *field,
+                                       char *out, const char *value,
+                                       size_t size)
+{
+    char buf[INI_FIELD_BUFFER_SIZE];
+    char *ptr = out + field->offset;
+    union ini_number number;
+    enum ini_status status;
+    float f;
+
+    if (field->type == INI_FIELD_STRING) {
+        if (size >= field->size)
+            return INI_ERROR_RANGE;
+
+        memcpy(ptr, value, size);
+        ptr[size] = '\0';
+        return INI_OK;
+    }
+
+    if (size >= sizeof buf)
+        return INI_ERROR_INVALID;
+
+    memcpy(buf, value, size);
+    buf[size] = '\0';
+
+    switch (field->type) {
+    case INI_FIELD_INT:
+    case INI_FIELD_UINT:
+        if ((status = ini_convert_int(buf, &number)) != INI_OK)
+            return status;
+
+        if (field->type == INI_FIELD_INT)
+            return ini_field_store_int(ptr, field->size, number.i);
+
+        if (number.i < 0)
+            return INI_ERROR_RANGE;
+
+        return ini_field_store_uint(ptr, field->size,
+                                    (unsigned long long) number.i);
+
+    case INI_FIELD_DOUBLE:
+        if ((status = ini_convert_double(buf, &number)) != INI_OK)
+            return status;
+
+        if (field->size == sizeof(double))
+            memcpy(ptr, &number.d, sizeof number.d);
+        else if (field->size == sizeof(float)) {
+            f = (float) number.d;
+            memcpy(ptr, &f, sizeof f);
+        }
+        else
+            return INI_ERROR_INVALID;
+
+        return INI_OK;
+
+    case INI_FIELD_BOOL:
+        if ((status = ini_convert_bool(buf, &number)) != INI_OK)
+            return status;
+
+        if (field->size != sizeof(bool))
+            return INI_ERROR_INVALID;
+
+        memcpy(ptr, &number.b, sizeof number.b);
+        return INI_OK;
+
+    case INI_FIELD_SIZE:
+        if ((status = ini_convert_size(buf, &number)) != INI_OK)
+            return status;
+
+        return ini_field_store_uint(ptr, field->size, number.size);
+
+    default:
+        return INI_ERROR_INVALID;
+    }
+}
+
+static bool ini_bind_section(const char *name, size_t size, void *user)
+{
+    struct ini_bind_state *state = (struct ini_bind_state*) user;
+    const struct ini_schema *schema = state->schema;
+    const char *section;
+    uint32_t i;
+
+    state->section_hash = ini_hash(name, size);
+    state->section = NULL;
+
+    for (i = 0; i < schema->count; ++i) {
+        if (schema->section_hashes[i] != state->section_hash)
+            continue;
+
+        section = ini_field_section(&schema->fields[i]);
+
+        if (strncmp(section, name, size) == 0 && section[size] == '\0') {
+            state->section = section;
+            break;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Stores `value` in the field of `key` in the current section. Keys
+ * without a value are skipped, as `ini_parse` does, so the field keeps
+ * its default like a missing key in `ini_get_int` and the rest.
+*/
+static bool ini_bind_kv(const char *key, size_t key_size, const char *value,
+                        size_t value_size, void *user)
+{
+    struct ini_bind_state *state = (struct ini_bind_state*) user;
+    const struct ini_schema *schema = state->schema;
+    const struct ini_field *field;
+    enum ini_status status;
+    uint64_t hash;
+    uint32_t i;
+
+    if (state->section == NULL || value_size == 0)
+        return true;
+
+    hash = ini_frozen_hash(state->section_hash, key, key_size);
+    i = schema->slots[ini_frozen_slot(hash, schema->buckets[
+        ini_frozen_bucket(hash, schema->bucket_count)], schema->slot_count)];
+
+    if (i == INI_FROZEN_NONE || schema->hashes[i] != hash)
+        return true;
+
+    field = &schema->fields[i];
+
+    if (strncmp(field->key, key, key_size) != 0 || field->key[key_size] != 0
+        || strcmp(ini_field_section(field), state->section) != 0)
+    {
+        return true;
+    }
+
+    status = ini_field_store(field, state->out, value, value_size);
+
+    if (state->status == INI_OK)
+        state->status = status;
+
+    return true;
+}
+
+/**
+ * Fills the members of `out` described by `schema` with their defaults
+ * and starts in the DEFAULT section.
+*/
+static void ini_bind_begin(struct ini_bind_state *state,
+                           const struct ini_schema *schema, void *out)
+{
+    const struct ini_field *field;
+    enum ini_status status;
+    uint32_t i;
+
+    state->schema = schema;
+    state->out = (char*) out;
+    state->status = INI_OK;
+
+    for (i = 0; i < schema->count; ++i) {
+        field = &schema->fields[i];
+
+        if (field->def == NULL)
+            continue;
+
+        status = ini_field_store(field, state->out, field->def,
+                                 strlen(field->def));
+
+        if (state->status == INI_OK)
+            state->status = status;
+    }
+
+    ini_bind_section(INI_DEFAULT_SECTION_NAME,
+                     sizeof INI_DEFAULT_SECTION_NAME - 1, state);
+}
+
+/**
+ * Parses `size` bytes of `buf` straight into the struct `out`, without
+ * building an `ini_t`: members described by `schema` get their
+ * defaults first, then every key of the input bound by `schema` is
+ * converted into its member, and other keys are skipped. If a key
+ * occurs several times, the last value wins. Nothing is allocated.
+ * 
+ * Returns INI_OK, INI_ERROR_MISSING if there is no input, or the first
+ * error of a conversion, whose member is left unchanged.
+*/
+static enum ini_status ini_bind_buffer(const struct ini_schema *schema,
+                                       const char *buf, size_t size,
+                                       void *out)
+{
+    struct ini_bind_state state;
+
+    if (schema == NULL || schema->hashes == NULL || buf == NULL)
+        return INI_ERROR_MISSING;
+
+    ini_bind_begin(&state, schema, out);
+    ini_parse_buffer_cb(buf, size, ini_bind_section, ini_bind_kv, NULL,
+                        &state);
+
+    return state.status;
+}
+
+/**
+ * Same as `ini_bind_buffer`, but for the I/O stream `io`, which is
+ * read in blocks of INI_IO_BUFFER_SIZE bytes. Returns
+ * INI_ERROR_MISSING if it can't be read.
+*/
+static enum ini_status ini_bind_io(const struct ini_schema *schema,
+                                   struct ini_io *io, void *out)
+{
+    struct ini_bind_state state;
+
+    if (schema == NULL || schema->hashes == NULL || io == NULL)
+        return INI_ERROR_MISSING;
+
+    ini_bind_begin(&state, schema, out);
+
+    if (!ini_parse_cb(io, ini_bind_section, ini_bind_kv, NULL, &state))
+        return INI_ERROR_MISSING;
+
+    return state.status;
+}
+
+/**
+ * Same as `ini_bind_buffer`, but for the file at `path`. Returns
+ * INI_ERROR_MISSING if it can't be read.
+*/
+static enum ini_status ini_bind_path(const struct ini_schema *schema,
+                                     const char *path, void *out)
+{
+    enum ini_status status;
+    struct ini_io io = {0};
+    FILE *fp;
+
+    if (path == NULL || (fp = fopen(path, "r")) == NULL)
+        return INI_ERROR_MISSING;
+
+    io.eof = ini_io_file_eof;
+    io.getc = ini_io_file_getc;
+    io.read = ini_io_file_read;
+    io.raw = (void*) fp;
+    io.mode = INI_IO_MODE_READ;
+
+    status = ini_bind_io(schema, &io, out);
+    fclose(fp);
+    return status;
+}
+
+/**
+ * Passes the buffered output of `writer` to its I/O stream.
+*/
+static void ini_writer_flush(struct ini_writer *writer)
+{
+    if (writer->io != NULL && writer->size > 0)
+        ini_io_write_block(writer->io, writer->buffer, writer->size);
+
+    writer->size = 0;
+}
+
+/**
+ * Appends `n` bytes of `data` to the output of `writer`. Blocks that
+ * don't fit into the buffer are written directly.
+*/
+static void ini_writer_put(struct ini_writer *writer, const char *data,
+                           size_t n)
+{
+    if (n == 0)
+        return;
+
+    if (n > writer->capacity - writer->size) {
+        if (writer->io == NULL)
+            n = writer->capacity - writer->size;
+        else {
+            ini_writer_flush(writer);
+
+            if (n >= writer->capacity) {
+                ini_io_write_block(writer->io, data, n);
+                return;
+            }
+        }
+    }
+
+    memcpy(writer->buffer + writer->size, data, n);
+    writer->size += n;
+}
+
+/**
+ * Prepares `writer` for writing to `io` through a buffer of
+ * INI_IO_BUFFER_SIZE bytes from `allocator`. Without the buffer, every
+ * piece of the output is written directly.
+*/
+static void ini_writer_open(struct ini_writer *writer, struct ini_io *io,
+                            const struct ini_allocator *allocator)
+{
+    writer->io = io;
+    writer->allocator = allocator;
+    writer->size = 0;
+    writer->buffer = (char*) ini_allocate(allocator, INI_IO_BUFFER_SIZE);
+    writer->capacity = writer->buffer ? INI_IO_BUFFER_SIZE : 0;
+}
+
+static void ini_writer_close(struct ini_writer *writer)
+{
+    ini_writer_flush(writer);
+    ini_deallocate(writer->allocator, writer->buffer);
+}
+
+/**
+ * Writes the keys of the section `sec` to `writer`, or only counts the
+ * bytes of the output if `writer` is NULL. Returns the number of keys,
+ * and adds the number of bytes to `*size` unless it is NULL.
+*/
+static size_t ini_store_section_to(struct ini_writer *writer,
+                                   struct ini_map *sec, size_t *size)
+{
+    const char separator[] = {' ', INI_KEY_VALUE_SEPARATORS[0], ' '};
+    struct ini_key_iter iter;
+    size_t count = 0, value_size;
+
+    ini_key_iter_init(&iter, sec);
+
+    for (; ini_key_iter_next(&iter); ++count) {
+        value_size = iter.value ? strlen(iter.value) : 0;
+
+        if (size != NULL)
+            *size += iter.size + sizeof separator + value_size + 1;
+
+        if (writer != NULL) {
+            ini_writer_put(writer, iter.key, iter.size);
+            ini_writer_put(writer, separator, sizeof separator);
+            ini_writer_put(writer, iter.value, value_size);
+            ini_writer_put(writer, "\n", 1);
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Writes `ini` to `writer`, or only counts the bytes of the output if
+ * `writer` is NULL. Returns the number of bytes.
+*/
+static size_t ini_store_to(struct ini_writer *writer, ini_t ini)
+{
+    struct ini_map *default_section;
+    struct ini_section_iter iter;
+    size_t size = 0;
+
+    default_section = (struct ini_map*)
+        ini_map_get(ini, INI_DEFAULT_SECTION_NAME);
+
+    if (default_section != NULL)
+        ini_store_section_to(writer, default_section, &size);
+
+    ini_section_iter_init(&iter, ini);
+
+    while (ini_section_iter_next(&iter)) {
+        if (iter.section == default_section)
+            continue;
+
+        size += iter.size + 3;
+
+        if (writer != NULL) {
+            ini_writer_put(writer, "[", 1);
+            ini_writer_put(writer, iter.name, iter.size);
+            ini_writer_put(writer, "]\n", 2);
+        }
+
+        ini_store_section_to(writer, iter.section, &size);
+    }
+
+    return size;
+}
+
+/**
+ * Writes section properties to the I/O stream.
+*/
+static size_t ini_store_section(struct ini_io *io, struct ini_map *sec)
+{
+    struct ini_writer writer;
+    size_t size = 0;
+
+    if (sec != NULL && io != NULL && io->mode == INI_IO_MODE_WRITE) {
+        ini_writer_open(&writer, io, sec->allocator);
+        size = ini_store_section_to(&writer, sec, NULL);
+        ini_writer_close(&writer);
+    }
+
+    return size;
+}
+
+/**
+ * Saves the ini_t structure to the specified I/O stream. The output is
+ * collected in a buffer and written in blocks of up to
+ * INI_IO_BUFFER_SIZE bytes.
+ * 
+ * The following fields of the I/O structure must not be NULL:
+ * - raw 
+ * - mode (should be INI_IO_MODE_WRITE)
+ * - write or putc
+*/
+static void ini_store(ini_t ini, struct ini_io *io)
+{
+    struct ini_writer writer;
+
+    if (ini != NULL && io != NULL && io->mode == INI_IO_MODE_WRITE) {
+        ini_writer_open(&writer, io, ini->allocator);
+        ini_store_to(&writer, ini);
+        ini_writer_close(&writer);
+    }
+}
+
+/**
+ * Returns the number of bytes `ini_store` writes for `ini`.
+*/
+static size_t ini_store_size(ini_t ini)
+{
+    return ini ? ini_store_to(NULL, ini) : 0;
+}
+
+/**
+ * Saves the ini_t structure to a new string, which is allocated at
+ * once with the exact size of the output. Returns NULL on error.
+ * 
+ * WARNING: Memory is allocated for the string with the allocator of
+ * `ini`, or with `INI_DEFAULT_ALLOCATOR` if it has none. Don't forget
+ * to free it with `ini_string_free`
+*/
+static char *ini_store_to_str(ini_t ini)
+{
+    struct ini_writer writer = {0};
+
+    if (ini == NULL)
+        return NULL;
+
+    writer.capacity = ini_store_size(ini);
+    writer.buffer = (char*) ini_allocate(ini->allocator, writer.capacity + 1);
+
+    if (writer.buffer != NULL) {
+        ini_store_to(&writer, ini);
+        writer.buffer[writer.size] = '\0';
+    }
+
+    return writer.buffer;
+}
+
+/**
+ * Frees the string `str` returned by `ini_store_to_str` for `ini`.
+*/
+static void ini_string_free(ini_t ini, char *str)
+{
+    if (ini != NULL)
+        ini_deallocate(ini->allocator, str);
+}
+
+/**
+ * Creates an ini structure from data read from a string.
+ * 
+ * WARNING: The string must end with `\0`, otherwise it may lead to
+ * undefined behavior.
+*/
+static ini_t ini_parse_from_str(const char *str)
+{
+    struct ini_parse_state state = {0};
+
+    if (str == NULL)
+        return NULL;
+
+    return ini_parse_buffer(str, strlen(str), &state);
+}
+
+/**
+ * Creates an ini structure from `size` bytes of the buffer `buf`.
+*/
+static ini_t ini_parse_from_buffer(const char *buf, size_t size)
+{
+    struct ini_parse_state state = {0};
+    return ini_parse_buffer(buf, size, &state);
+}
+
+/**
+ * Returns the offset of the first section line of the `size` bytes of
+ * `buf` that starts at `pos` or after it, or `size` if there is none.
+*/
+static size_t ini_find_section(struct ini_scanner *scanner, const char *buf,
+                               size_t size, size_t pos)
+{
+    struct ini_line_tokens tokens;
+    const char *end = buf + size;
+    const char *line, *p;
+
+    if (pos > 0 && buf[pos - 1] != '\n') {
+        p = (const char*) memchr(buf + pos, '\n', size - pos);
+        pos = p ? (size_t) (p - buf) + 1 : size;
+    }
+
+    scanner->block = NULL;
+
+    for (line = buf + pos; line < end; line = tokens.next) {
+        ini_scan_line(scanner, line, end, &tokens);
+
+        p = tokens.line;
+
+        while (p < line + tokens.size && ini_isspace(*p))
+            ++p;
+
+        /* Same as in `ini_parse_tokens` */
+        if (p < line + tokens.size && *p == '['
+            && tokens.separator == tokens.size
+            && tokens.section_end < tokens.size)
+        {
+            return (size_t) (line - buf);
+        }
+    }
+
+    return size;
+}
+
+/**
+ * Moves all sections and keys of `src` into `dst`, where the keys of
+ * `src` overwrite the ones of `dst`, as if `src` were parsed after
+ * `dst`. Moved values are taken from `src`, which is freed. Both must
+ * have been created by `ini_new`. Returns false on error.
+*/
+static bool ini_merge_move(ini_t dst, ini_t src)
+{
+    struct ini_map_entry *sec, *prev, *cur, *entry;
+    struct ini_map *section;
+    bool result = true;
+
+    for (sec = src->first; sec != NULL && result; sec = sec->next) {
+        prev = ini_map_find_entry(dst, sec);
+
+        /* Sections that are new to `dst` are moved as a whole */
+        if (prev == NULL) {
+            result = ini_map_insert_hashed(dst, sec->hash, sec->key,
+                                           sec->size, sec->value, false);
+
+            if (result) {
+                if (dst->index != NULL)
+                    ini_index_insert(dst, dst->last);
+
+                sec->value = NULL;
+            }
+
+            continue;
+        }
+
+        section = (struct ini_map*) prev->value;
+
+        for (cur = ((struct ini_map*) sec->value)->first;
+             cur != NULL && result; cur = cur->next)
+        {
+            entry = ini_map_upsert(section, cur->hash, cur->key, cur->size,
+                                   false);
+
+            if ((result = (entry != NULL)) == false)
+                break;
+
+            /* Values inside the entries of `src` have to be copied */
+            if (cur->value == cur->inline_value)
+                result = ini_map_entry_assign_n(section, entry,
+                                                cur->inline_value,
+                                                strlen(cur->inline_value));
+            else {
+                ini_map_entry_assign(section, entry, cur->value);
+                cur->value = NULL;
+            }
+        }
+    }
+
+    INI_STATS(dst->counters.lines += src->counters.lines);
+    INI_STATS(dst->counters.bytes += src->counters.bytes);
+    INI_STATS(dst->counters.parse_time += src->counters.parse_time);
+
+    ini_free(src);
+    return result;
+}
+
+static void *ini_parse_job_run(void *arg)
+{
+    struct ini_parse_job *job = (struct ini_parse_job*) arg;
+
+    job->ini = ini_parse_from_buffer(job->buf, job->size);
+    return NULL;
+}
+
+/**
+ * Creates an ini structure from `len` bytes of `buf` using up to
+ * `nthreads` threads. The input is split into chunks that start with
+ * a section line, which are parsed in parallel and then merged in
+ * order, so the result is the same as of `ini_parse_from_buffer`: for
+ * keys that occur several times, the last value wins.
+ * 
+ * Inputs of less than INI_PARALLEL_MIN_CHUNK bytes per thread use
+ * fewer threads, and without POSIX threads the chunks are parsed one
+ * after another. Returns NULL on error.
+*/
+static ini_t ini_parse_parallel(const char *buf, size_t len, unsigned nthreads)
+{
+    struct ini_parse_job jobs[INI_PARALLEL_MAX_THREADS] = {{0}};
+    struct ini_scanner scanner;
+    size_t start = 0, end, i, count;
+    ini_t ini = NULL;
+    bool result = true;
+#ifdef INI_HAS_PTHREADS
+    pthread_t threads[INI_PARALLEL_MAX_THREADS];
+    bool started[INI_PARALLEL_MAX_THREADS] = {0};
+#endif /* INI_HAS_PTHREADS */
+
+    if (buf == NULL)
+        return NULL;
+
+    count = len / INI_PARALLEL_MIN_CHUNK;
+
+    if (count > nthreads)
+        count = nthreads;
+
+    if (count > INI_PARALLEL_MAX_THREADS)
+        count = INI_PARALLEL_MAX_THREADS;
+
+    if (count <= 1)
+        return ini_parse_from_buffer(buf, len);
+
+    ini_scanner_init(&scanner);
+
+    for (i = 0; i < count; ++i) {
+        if (i + 1 == count)
+            end = len;
+        else
+            end = ini_find_section(&scanner, buf, len, len / count * (i + 1));
+
+        if (end < start)
+            end = start;
+
+        jobs[i].buf = buf + start;
+        jobs[i].size = end - start;
+        start = end;
+    }
+
+#ifdef INI_HAS_PTHREADS
+    for (i = 1; i < count; ++i) {
+        if (jobs[i].size > 0)
+            started[i] = pthread_create(&threads[i], NULL, ini_parse_job_run,
+                                        &jobs[i]) == 0;
+    }
+#endif /* INI_HAS_PTHREADS */
+
+    for (i = 0; i < count; ++i) {
+#ifdef INI_HAS_PTHREADS
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+            continue;
+        }
+#endif /* INI_HAS_PTHREADS */
+
+        if (i == 0 || jobs[i].size > 0)
+            ini_parse_job_run(&jobs[i]);
+    }
+
+    for (i = 0; i < count; ++i) {
+        if (i == 0 || jobs[i].size > 0)
+            result = result && jobs[i].ini != NULL;
+    }
+
+    if (result) {
+        ini = jobs[0].ini;
+
+        for (i = 1, start = ini->size; i < count; ++i)
+            start += jobs[i].ini ? jobs[i].ini->size : 0;
+
+        /* Sections of all chunks are added to the table at once */
+        ini_map_reserve(ini, start);
+
+        for (i = 1; i < count && result; ++i) {
+            if (jobs[i].ini != NULL) {
+                result = ini_merge_move(ini, jobs[i].ini);
+                jobs[i].ini = NULL;
+            }
+        }
+    }
+
+    if (!result) {
+        for (i = 0; i < count; ++i)
+            ini_free(jobs[i].ini);
+
+        return NULL;
+    }
+
+    return ini;
+}
+
+/**
+ * Creates an ini structure from `len` bytes of the writable buffer
+ * `buf` without copying any keys or values: they are terminated with
+ * `\0` inside `buf` and the ini structure refers to them. Sections and
+ * entries are allocated in an arena (see `ini_new_arena`).
+ * 
+ * WARNING: `buf` is modified and must stay alive until `ini_free`.
+ * Strings returned by `ini_get` point into it.
+*/
+static ini_t ini_parse_inplace(char *buf, size_t len)
+{
+    struct ini_parse_state state = {0};
+
+    if (buf == NULL)
+        return NULL;
+
+    state.ini = ini_new_arena(len);
+    state.inplace_end = buf + len;
+
+    if (state.ini == NULL)
+        return NULL;
+
+    return ini_parse_buffer(buf, len, &state);
+}
+
+/**
+ * Creates an ini structure from data read from an open file stream.
+*/
+static ini_t ini_parse_from_file(FILE *fp)
+{
+    struct ini_parse_state state = {0};
+    struct ini_io io = {0};
+
+    io.eof = ini_io_file_eof;
+    io.getc = ini_io_file_getc;
+    io.read = ini_io_file_read;
+    io.raw = (void*) fp;
+    io.mode = INI_IO_MODE_READ;
+
+    return ini_parse(&io, &state);
+}
+
+/**
+ * Creates an ini structure from a file at the given path by mapping it
+ * into memory and scanning the mapped bytes directly. Returns NULL if
+ * the file can't be opened or isn't a regular file (e.g. a pipe).
+ * 
+ * NOTE: On platforms without `mmap`, or if `INI_NO_MMAP` is defined,
+ * the file is read with stdio.
+*/
+static ini_t ini_parse_mapped(const char *path)
+{
+#ifdef INI_HAS_MMAP
+    struct stat st;
+    ini_t tmp = NULL;
+    void *data;
+    size_t size;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+        && (uintmax_t) st.st_size <= SIZE_MAX)
+    {
+        size = (size_t) st.st_size;
+
+        if (size == 0)
+            tmp = ini_parse_from_buffer("", 0);
+        else {
+            data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED) {
+                tmp = ini_parse_from_buffer((const char*) data, size);
+                munmap(data, size);
+            }
+        }
+    }
+
+    close(fd);
+    return tmp;
+#else
+    ini_t tmp = NULL;
+    FILE *fp = fopen(path, "r");
+
+    if (fp != NULL) {
+        tmp = ini_parse_from_file(fp);
+        fclose(fp);
+    }
+
+    return tmp;
+#endif /* INI_HAS_MMAP */
+}
+
+/**
+ * Creates an ini structure from data read from a file at the given
+ * path. Regular files are mapped into memory when possible, anything
+ * else is read with stdio.
+*/
+static ini_t ini_parse_from_path(const char *path)
+{
+    ini_t tmp = NULL;
+    FILE *fp;
+
+#ifdef INI_HAS_MMAP
+    if ((tmp = ini_parse_mapped(path)) != NULL)
+        return tmp;
+#endif /* INI_HAS_MMAP */
+
+    if ((fp = fopen(path, "r")) != NULL) {
+        tmp = ini_parse_from_file(fp);
+        fclose(fp);
+    }
+
+    return tmp;
+}
+
+/**
+ * Saves the contents of the ini structure to an open file stream.
+*/
+static void ini_store_to_file(ini_t ini, FILE *fp)
+{
+    struct ini_io io = {0};
+    io.putc = ini_io_file_putc;
+    io.write = ini_io_file_write;
+    io.raw = (void*) fp;
+    io.mode = INI_IO_MODE_WRITE;
+    
+    ini_store(ini, &io);
+}
+
+/**
+ * Saves the contents of the ini structure to a file at the specified
+ * path.
+*/
+static void ini_store_to_path(ini_t ini, const char *path)
+{
+    FILE *fp;
+
+    if ((fp = fopen(path, "w")) != NULL) {
+        ini_store_to_file(ini, fp);
+        fclose(fp);
+    }
+}
+
+/**
+ * Returns the checksum of the snapshot `frozen`, which is the hash of
+ * its header, with `checksum` and `flags` taken as 0, and its tables.
+*/
+static uint64_t ini_frozen_checksum(ini_frozen_t frozen)
+{
+    struct ini_frozen header = *frozen;
+
+    header.flags = 0;
+    header.checksum = 0;
+
+    return ini_wyhash((const char*) (frozen + 1),
+                      (size_t) frozen->size - sizeof header,
+                      ini_wyhash((const char*) &header, sizeof header, 0));
+}
+
+/**
+ * Checks that the `size` bytes at `frozen` are a snapshot written by
+ * this version of the library: the header must match, all of the
+ * tables must lie within the snapshot and the checksum must be right.
+*/
+static bool ini_frozen_valid(ini_frozen_t frozen, size_t size)
+{
+    uint64_t end = frozen->strings;
+
+    if (size < sizeof *frozen || frozen->magic != INI_FROZEN_MAGIC
+        || frozen->version != INI_FROZEN_VERSION
+        || frozen->seed != (uint64_t) INI_HASH_SEED
+        || frozen->size != size || frozen->bucket_count == 0
+        || frozen->slot_count <= frozen->key_count)
+    {
+        return false;
+    }
+
+    if (frozen->slots < sizeof *frozen || frozen->slots % 8 != 0
+        || frozen->slots + (uint64_t) frozen->slot_count
+           * sizeof(struct ini_frozen_key) > frozen->sections
+        || frozen->sections + (uint64_t) frozen->section_count
+           * sizeof(struct ini_frozen_section) > frozen->buckets
+        || frozen->buckets + (uint64_t) frozen->bucket_count
+           * sizeof(uint32_t) > frozen->order
+        || frozen->order + (uint64_t) frozen->key_count
+           * sizeof(uint32_t) > end || end > size)
+    {
+        return false;
+    }
+
+    return frozen->checksum == ini_frozen_checksum(frozen);
+}
+
+/**
+ * Stores the modification time of the file at `path`, in nanoseconds,
+ * and its size in `mtime` and `size`. Returns false if they are
+ * unknown. Where the nanoseconds aren't available, `mtime` has whole
+ * seconds only, and an edit that keeps the size within the same second
+ * goes unnoticed.
+*/
+static bool ini_source_stamp(const char *path, int64_t *mtime, uint64_t *size)
+{
+#ifdef INI_HAS_MMAP
+    struct stat st;
+    long nsec = 0;
+
+    if (path == NULL || stat(path, &st) != 0)
+        return false;
+
+#if defined(__APPLE__)
+    nsec = (long) st.st_mtimespec.tv_nsec;
+#elif defined(st_mtime)
+    /* `st_mtime` is defined as `st_mtim.tv_sec` when `st_mtim` exists */
+    nsec = (long) st.st_mtim.tv_nsec;
+#elif defined(__GLIBC__)
+    nsec = (long) st.st_mtimensec;
+#endif
+
+    *mtime = (int64_t) st.st_mtime * 1000000000 + nsec;
+    *size = (uint64_t) st.st_size;
+    return true;
+#else
+    (void) path;
+    (void) mtime;
+    (void) size;
+    return false;
+#endif /* INI_HAS_MMAP */
+}
+
+/**
+ * Writes the snapshot `frozen`, stamped with the modification time and
+ * size of the file at `source`, to a file at `path`. The file is
+ * written next to `path` and then renamed, so readers never see a
+ * partial cache. Returns true if everything went well.
+*/
+static bool ini_frozen_write(struct ini_frozen *frozen, const char *path,
+                             const char *source)
+{
+    size_t size = strlen(path);
+    bool result = false;
+    char *tmp;
+    FILE *fp;
+
+    if (!ini_source_stamp(source, &frozen->source_mtime,
+                          &frozen->source_size))
+    {
+        frozen->source_mtime = 0;
+        frozen->source_size = 0;
+    }
+
+    frozen->flags = 0;
+    frozen->checksum = ini_frozen_checksum(frozen);
+
+    if ((tmp = (char*) ini_allocate(NULL, size + sizeof ".tmp")) == NULL)
+        return false;
+
+    memcpy(tmp, path, size);
+    memcpy(tmp + size, ".tmp", sizeof ".tmp");
+
+    if ((fp = fopen(tmp, "wb")) != NULL) {
+        result = fwrite(frozen, 1, (size_t) frozen->size, fp)
+                 == frozen->size;
+        result = (fclose(fp) == 0) && result;
+
+        if (result && rename(tmp, path) != 0) {
+            /* Some systems don't replace existing files */
+            remove(path);
+            result = (rename(tmp, path) == 0);
+        }
+
+        if (!result)
+            remove(tmp);
+    }
+
+    ini_deallocate(NULL, tmp);
+    return result;
+}
+
+/**
+ * Saves `ini` as a binary cache at `path`: a frozen snapshot (see
+ * `ini_freeze`) that `ini_load_binary` maps back into memory without
+ * parsing. The cache is stamped with the modification time and size of
+ * the file at `source`, which may be NULL. Returns true if everything
+ * went well.
+ * 
+ * NOTE: The cache is only readable by builds for the same platform and
+ * with the same `INI_HASH_SEED`.
+*/
+static bool ini_store_binary(ini_t ini, const char *path, const char *source)
+{
+    struct ini_frozen *frozen;
+    bool result;
+
+    if (path == NULL || (frozen = (struct ini_frozen*) ini_freeze(ini)) == NULL)
+        return false;
+
+    result = ini_frozen_write(frozen, path, source);
+    ini_frozen_free(frozen);
+    return result;
+}
+
+/**
+ * Loads the binary cache at `path` written by `ini_store_binary`.
+ * Returns NULL if it doesn't exist or isn't valid.
+*/
+static ini_frozen_t ini_load_binary_cache(const char *path)
+{
+    struct ini_frozen *frozen = NULL;
+
+#ifdef INI_HAS_MMAP
+    struct stat st;
+    void *data;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+        && (uintmax_t) st.st_size >= sizeof *frozen
+        && (uintmax_t) st.st_size <= SIZE_MAX)
+    {
+        /* The private mapping lets `flags` be set in the header only */
+        data = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE, fd, 0);
+
+        if (data != MAP_FAILED) {
+            frozen = (struct ini_frozen*) data;
+
+            if (ini_frozen_valid(frozen, (size_t) st.st_size))
+                frozen->flags = INI_FROZEN_MAPPED;
+            else {
+                munmap(data, (size_t) st.st_size);
+                frozen = NULL;
+            }
+        }
+    }
+
+    close(fd);
+#else
+    struct ini_frozen header;
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL)
+        return NULL;
+
+    if (fread(&header, sizeof header, 1, fp) == 1
+        && header.size >= sizeof header && header.size <= SIZE_MAX
+        && (frozen = (struct ini_frozen*)
+                ini_allocate(NULL, (size_t) header.size)))
+    {
+        *frozen = header;
+
+        if (fread(frozen + 1, 1, (size_t) header.size - sizeof header, fp)
+            != header.size - sizeof header || fgetc(fp) != EOF
+            || !ini_frozen_valid(frozen, (size_t) header.size))
+        {
+            ini_deallocate(NULL, frozen);
+            frozen = NULL;
+        }
+        else
+            frozen->flags = 0;
+    }
+
+    fclose(fp);
+#endif /* INI_HAS_MMAP */
+
+    return frozen;
+}
+
+/**
+ * Loads the binary cache at `path` written by `ini_store_binary`,
+ * which is mapped into memory as is, without parsing or allocating
+ * anything per entry.
+ * 
+ * If `source` is not NULL and the cache is missing, invalid or stale,
+ * that is, the modification time or size of the file at `source`
+ * differ from the ones stored in the cache, then `source` is parsed
+ * with `ini_parse_from_path` and frozen instead, and the cache is
+ * rewritten. Returns NULL on error.
+ * 
+ * WARNING: Don't forget to free memory with `ini_frozen_free`
+*/
+static ini_frozen_t ini_load_binary(const char *path, const char *source)
+{
+    ini_frozen_t frozen = NULL;
+    struct ini_frozen *fresh;
+    uint64_t source_size;
+    int64_t source_mtime;
+    ini_t ini;
+
+    if (path != NULL)
+        frozen = ini_load_binary_cache(path);
+
+    if (source == NULL)
+        return frozen;
+
+    if (frozen != NULL) {
+        if (ini_source_stamp(source, &source_mtime, &source_size)
+            && frozen->source_mtime == source_mtime
+            && frozen->source_size == source_size)
+        {
+            return frozen;
+        }
+
+        ini_frozen_free(frozen);
+    }
+
+    if ((ini = ini_parse_from_path(source)) == NULL)
+        return NULL;
+
+    fresh = (struct ini_frozen*) ini_freeze(ini);
+    ini_free(ini);
+
+    if (fresh != NULL && path != NULL)
+        ini_frozen_write(fresh, path, source);
+
+    return fresh;
+}
+
+#ifdef INI_HAS_ATOMICS
+/**
+ * Creates a reloadable `ini_t` from the file at `path`, which can be
+ * read from many threads while `ini_shared_reload` replaces it.
+ * Returns NULL on error.
+ * 
+ * WARNING: Don't forget to free memory with `ini_shared_free`
+*/
+static ini_shared_t ini_shared_new(const char *path)
+{
+    ini_shared_t shared;
+
+    if (path == NULL)
+        return NULL;
+
+    shared = (ini_shared_t) ini_callocate(NULL, 1, sizeof *shared);
+
+    if (shared == NULL)
+        return NULL;
+
+    shared->epoch = 1;
+    shared->path = ini_strdup(path);
+    shared->current = ini_parse_from_path(path);
+
+    if (shared->path == NULL || shared->current == NULL) {
+        ini_deallocate(NULL, shared->path);
+        ini_free(shared->current);
+        ini_deallocate(NULL, shared);
+        return NULL;
+    }
+
+    return shared;
+}
+
+/**
+ * Takes a free reader slot of `shared` for the calling thread, and
+ * returns its number, or -1 if all INI_SHARED_MAX_READERS slots are
+ * taken. A slot must not be used by several threads at once.
+*/
+static int ini_shared_register(ini_shared_t shared)
+{
+    int i, unused;
+
+    for (i = 0; i < INI_SHARED_MAX_READERS; ++i) {
+        unused = 0;
+
+        if (__atomic_compare_exchange_n(&shared->readers[i].used, &unused, 1,
+                                        false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_RELAXED))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Gives back the reader slot `reader` taken by `ini_shared_register`.
+*/
+static void ini_shared_unregister(ini_shared_t shared, int reader)
+{
+    __atomic_store_n(&shared->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&shared->readers[reader].used, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Enters a read-side critical section on the slot `reader` and returns
+ * the current `ini_t`, which stays valid until `ini_shared_release`.
+ * Critical sections on the same slot must not be nested.
+ * 
+ * NOTE: Only the functions that don't change `ini` may be called on
+ * it. Typed accessors like `ini_get_int` are safe to call from several
+ * readers, see `ini_get_typed_h`.
+*/
+static ini_t ini_shared_acquire(ini_shared_t shared, int reader)
+{
+    __atomic_store_n(&shared->readers[reader].epoch,
+                     __atomic_load_n(&shared->epoch, __ATOMIC_SEQ_CST),
+                     __ATOMIC_SEQ_CST);
+
+    return __atomic_load_n(&shared->current, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Leaves the read-side critical section entered by `ini_shared_acquire`
+*/
+static void ini_shared_release(ini_shared_t shared, int reader)
+{
+    __atomic_store_n(&shared->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Frees the replaced `ini_t` objects of `shared` that no reader can be
+ * using anymore. Must be called with the lock of `shared` held.
+*/
+static void ini_shared_collect(ini_shared_t shared)
+{
+    struct ini_shared_retired **link = &shared->retired, *cur;
+    uint64_t oldest = UINT64_MAX, epoch;
+    int i;
+
+    for (i = 0; i < INI_SHARED_MAX_READERS; ++i) {
+        epoch = __atomic_load_n(&shared->readers[i].epoch, __ATOMIC_SEQ_CST);
+
+        if (epoch != 0 && epoch < oldest)
+            oldest = epoch;
+    }
+
+    /* Readers of the epoch `cur->epoch` may still see `cur->ini` */
+    while ((cur = *link) != NULL) {
+        if (cur->epoch < oldest) {
+            *link = cur->next;
+            ini_free(cur->ini);
+            ini_deallocate(NULL, cur);
+        }
+        else
+            link = &cur->next;
+    }
+}
+
+static void ini_shared_lock(ini_shared_t shared)
+{
+    while (__atomic_exchange_n(&shared->lock, 1, __ATOMIC_ACQUIRE))
+        while (__atomic_load_n(&shared->lock, __ATOMIC_RELAXED));
+}
+
+static void ini_shared_unlock(ini_shared_t shared)
+{
+    __atomic_store_n(&shared->lock, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Frees the replaced `ini_t` objects of `shared` that no reader can be
+ * using anymore. Reloads do it as well, so this is only needed to
+ * release memory sooner.
+*/
+static void ini_shared_reclaim(ini_shared_t shared)
+{
+    ini_shared_lock(shared);
+    ini_shared_collect(shared);
+    ini_shared_unlock(shared);
+}
+
+/**
+ * Parses the file of `shared` again with `ini_parse_from_path` and
+ * publishes the result to the readers. The old `ini_t` is freed as
+ * soon as no reader can be using it. Returns false on error, in which
+ * case the old `ini_t` is kept.
+*/
+static bool ini_shared_reload(ini_shared_t shared)
+{
+    struct ini_shared_retired *retired;
+    ini_t fresh, old;
+
+    if (shared == NULL)
+        return false;
+
+    fresh = ini_parse_from_path(shared->path);
+    retired = (struct ini_shared_retired*) ini_allocate(NULL, sizeof *retired);
+
+    if (fresh == NULL || retired == NULL) {
+        ini_free(fresh);
+        ini_deallocate(NULL, retired);
+        return false;
+    }
+
+    ini_shared_lock(shared);
+
+    old = __atomic_exchange_n(&shared->current, fresh, __ATOMIC_SEQ_CST);
+
+    retired->ini = old;
+    retired->epoch = __atomic_fetch_add(&shared->epoch, 1, __ATOMIC_SEQ_CST);
+    retired->next = shared->retired;
+    shared->retired = retired;
+
+    ini_shared_collect(shared);
+    ini_shared_unlock(shared);
+    return true;
+}
+
+/**
+ * Frees memory for `shared` and every `ini_t` it has held. No reader
+ * may be inside a critical section.
+*/
+static void ini_shared_free(ini_shared_t shared)
+{
+    struct ini_shared_retired *cur, *next;
+
+    if (shared != NULL) {
+        for (cur = shared->retired; cur != NULL; cur = next) {
+            next = cur->next;
+            ini_free(cur->ini);
+            ini_deallocate(NULL, cur);
         }
 
-        free(entries);
+        ini_free(shared->current);
+        ini_deallocate(NULL, shared->path);
+        ini_deallocate(NULL, shared);
     }
+}
+#endif /* INI_HAS_ATOMICS */
 
-    return size;
+#ifdef INI_HAS_INOTIFY
+/**
+ * Creates a watcher of the INI file at `path`. The directory of the
+ * file is watched, so that files replaced by renaming, as most editors
+ * do, are noticed as well. Returns NULL on error.
+ * 
+ * WARNING: Don't forget to free memory with `ini_watcher_free`
+*/
+static ini_watcher_t ini_watcher_new(const char *path)
+{
+    ini_watcher_t watcher;
+    const char *slash;
+    char *dir;
+
+    if (path == NULL || *path == '\0' || path[strlen(path) - 1] == '/')
+        return NULL;
+
+    slash = strrchr(path, '/');
+
+    watcher = (ini_watcher_t) ini_callocate(NULL, 1, sizeof *watcher);
+
+    if (watcher == NULL)
+        return NULL;
+
+    watcher->fd = -1;
+    watcher->path = ini_strdup(path);
+
+    if (slash == NULL)
+        dir = ini_strdup(".");
+    else
+        dir = ini_strndup(path, (slash == path) ? 1 : (size_t) (slash - path));
+
+    if (watcher->path != NULL && dir != NULL) {
+        watcher->name = watcher->path + (slash ? slash - path + 1 : 0);
+        watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+        if (watcher->fd >= 0
+            && inotify_add_watch(watcher->fd, dir,
+                                 IN_CLOSE_WRITE | IN_MOVED_TO) >= 0)
+        {
+            watcher->ini = ini_parse_from_path(path);
+        }
+    }
+
+    ini_deallocate(NULL, dir);
+
+    if (watcher->ini == NULL) {
+        if (watcher->fd >= 0)
+            close(watcher->fd);
+
+        ini_deallocate(NULL, watcher->path);
+        ini_deallocate(NULL, watcher);
+        return NULL;
+    }
+
+    return watcher;
+}
+
+/**
+ * Registers `callback` to be called with `user` for every change found
+ * by `ini_watcher_poll`. Returns true if everything went well.
+*/
+static bool ini_watcher_on_change(ini_watcher_t watcher,
+                                  ini_diff_callback callback, void *user)
+{
+    struct ini_watcher_callback *callbacks;
+
+    if (watcher == NULL || callback == NULL)
+        return false;
+
+    callbacks = (struct ini_watcher_callback*)
+        ini_reallocate(NULL, watcher->callbacks,
+                       (watcher->callback_count + 1) * sizeof *callbacks);
+
+    if (callbacks == NULL)
+        return false;
+
+    callbacks[watcher->callback_count].callback = callback;
+    callbacks[watcher->callback_count].user = user;
+
+    watcher->callbacks = callbacks;
+    watcher->callback_count++;
+    return true;
+}
+
+/**
+ * Returns the descriptor that becomes readable when the watched
+ * directory changes, to be used with `poll` or `epoll`.
+*/
+static int ini_watcher_fd(ini_watcher_t watcher)
+{
+    return watcher ? watcher->fd : -1;
+}
+
+/**
+ * Returns the contents of the watched file as of the last change. It
+ * is freed by the next `ini_watcher_poll` that finds a change.
+*/
+static ini_t ini_watcher_ini(ini_watcher_t watcher)
+{
+    return watcher ? watcher->ini : NULL;
+}
+
+static void ini_watcher_dispatch(enum ini_change change, const char *section,
+                                 const char *key, const char *old_value,
+                                 const char *new_value, void *user)
+{
+    ini_watcher_t watcher = (ini_watcher_t) user;
+    size_t i;
+
+    for (i = 0; i < watcher->callback_count; ++i) {
+        watcher->callbacks[i].callback(change, section, key, old_value,
+                                       new_value, watcher->callbacks[i].user);
+    }
 }
 
 /**
- * Saves the ini_t structure to the specified I/O stream.
+ * Waits up to `timeout` milliseconds (-1 means forever, 0 - not at
+ * all) for the watched file to be written. When it is, the file is
+ * parsed again, compared with its previous contents by `ini_diff`, and
+ * every change is reported to the registered callbacks.
  * 
- * The following fields of the I/O structure must not be NULL:
- * - raw 
- * - mode (should be INI_IO_MODE_WRITE)
- * - putc 
+ * Returns the number of changes, or -1 on error. If the file can't be
+ * parsed, for example because it was removed, the previous contents
+ * are kept and 0 is returned.
 */
-static void ini_store(ini_t ini, struct ini_io *io)
+static int ini_watcher_poll(ini_watcher_t watcher, int timeout)
 {
-    struct ini_map_entry **entries, *cur;
-    struct ini_map *default_section;
-    size_t size;
-    int i;
+    union {
+        struct inotify_event                event;
+        char                                buffer[4096];
+    } events;
+    const struct inotify_event *event;
+    struct pollfd pfd;
+    bool changed = false;
+    size_t count;
+    ssize_t size;
+    char *p;
+    ini_t fresh;
+
+    if (watcher == NULL)
+        return -1;
+
+    pfd.fd = watcher->fd;
+    pfd.events = POLLIN;
+
+    if (poll(&pfd, 1, timeout) < 0)
+        return -1;
+
+    while ((size = read(watcher->fd, events.buffer, sizeof events)) > 0) {
+        for (p = events.buffer; p < events.buffer + size;
+             p += sizeof *event + event->len)
+        {
+            event = (const struct inotify_event*) p;
+
+            if (event->len > 0 && strcmp(event->name, watcher->name) == 0)
+                changed = true;
+        }
+    }
 
-    if (ini != NULL && io != NULL && io->mode == INI_IO_MODE_WRITE) {
-        size = ini_map_enumerate(ini, &entries);
+    if (!changed || (fresh = ini_parse_from_path(watcher->path)) == NULL)
+        return 0;
 
-        default_section = (struct ini_map*)
-            ini_map_get(ini, INI_DEFAULT_SECTION_NAME);
+    count = ini_diff(watcher->ini, fresh, ini_watcher_dispatch, watcher);
 
-        if (default_section != NULL)
-            ini_store_section(io, default_section);
+    ini_free(watcher->ini);
+    watcher->ini = fresh;
+    return (int) count;
+}
 
-        for (i = 0; i < size; ++i) {
-            cur = entries[i];
+/**
+ * Frees memory for `watcher`, including its `ini_t`.
+*/
+static void ini_watcher_free(ini_watcher_t watcher)
+{
+    if (watcher != NULL) {
+        close(watcher->fd);
+        ini_free(watcher->ini);
+        ini_deallocate(NULL, watcher->callbacks);
+        ini_deallocate(NULL, watcher->path);
+        ini_deallocate(NULL, watcher);
+    }
+}
+#endif /* INI_HAS_INOTIFY */
 
-            if (strcmp(cur->key, INI_DEFAULT_SECTION_NAME) == 0)
-                continue;
+/**
+ * Creates an empty overlay. Returns NULL on error.
+ * 
+ * WARNING: Don't forget to free memory with `ini_overlay_free`
+*/
+static ini_overlay_t ini_overlay_new(void)
+{
+    return (ini_overlay_t) ini_callocate(NULL, 1, sizeof(struct ini_overlay));
+}
+
+/**
+ * Frees `overlay` and all of its layers.
+*/
+static void ini_overlay_free(ini_overlay_t overlay)
+{
+    size_t i;
+
+    if (overlay != NULL) {
+        for (i = 0; i < overlay->count; ++i)
+            ini_free(overlay->layers[i].ini);
+
+        ini_deallocate(NULL, overlay->layers);
+        ini_deallocate(NULL, overlay);
+    }
+}
+
+/**
+ * Forgets the keys resolved by `overlay`. Call it after changing one
+ * of its layers other than with `ini_overlay_set`.
+*/
+static void ini_overlay_invalidate(ini_overlay_t overlay)
+{
+    if (overlay != NULL)
+        memset(overlay->cache, 0, sizeof overlay->cache);
+}
+
+/**
+ * Same as `ini_overlay_push`, but the section `includes` of `ini`, if
+ * not NULL, is left out of lookups.
+*/
+static bool ini_overlay_push_layer(ini_overlay_t overlay, ini_t ini,
+                                   const struct ini_map *includes)
+{
+    struct ini_overlay_layer *layers;
+    size_t capacity;
+
+    if (overlay == NULL || ini == NULL) {
+        ini_free(ini);
+        return false;
+    }
 
-            io->putc(io, '[');
-            ini_io_write(io, cur->key);
-            ini_io_write(io, "]\n");
-            ini_store_section(io, (struct ini_map*) cur->value);
+    if (overlay->count == overlay->capacity) {
+        capacity = overlay->capacity ? overlay->capacity * 2 : 4;
+        layers = (struct ini_overlay_layer*) ini_reallocate(
+            NULL, overlay->layers, capacity * sizeof *layers);
+
+        if (layers == NULL) {
+            ini_free(ini);
+            return false;
         }
 
-        free(entries);
+        overlay->layers = layers;
+        overlay->capacity = capacity;
     }
+
+    overlay->layers[overlay->count].ini = ini;
+    overlay->layers[overlay->count].includes = includes;
+    ++overlay->count;
+
+    ini_overlay_invalidate(overlay);
+    return true;
 }
 
 /**
- * Creates an ini structure from data read from a string.
+ * Puts `ini` on top of the layers of `overlay`, so its keys override
+ * the keys of all layers below. The overlay takes ownership of `ini`,
+ * which is freed with it, even if this fails. Returns true if
+ * everything went well.
+*/
+static bool ini_overlay_push(ini_overlay_t overlay, ini_t ini)
+{
+    return ini_overlay_push_layer(overlay, ini, NULL);
+}
+
+/**
+ * Returns a copy of `path` relative to the directory of the file at
+ * `base`, or of `path` itself if it is absolute or `base` has no
+ * directory. Returns NULL on error.
+*/
+static char *ini_overlay_path(const char *base, const char *path)
+{
+    const char *slash = strrchr(base, '/');
+    size_t dir_size, size;
+    char *result;
+
+    if (path[0] == '/' || slash == NULL)
+        return ini_strdup(path);
+
+    dir_size = (size_t) (slash - base) + 1;
+    size = strlen(path);
+    result = (char*) ini_allocate(NULL, dir_size + size + 1);
+
+    if (result != NULL) {
+        memcpy(result, base, dir_size);
+        memcpy(result + dir_size, path, size + 1);
+    }
+
+    return result;
+}
+
+/**
+ * File being loaded by `ini_overlay_load_at`, linked to the file that
+ * included it.
+*/
+struct ini_overlay_loading {
+    const char                             *path;
+    const struct ini_overlay_loading       *parent;
+#ifdef INI_HAS_MMAP
+    uint64_t                                device;
+    uint64_t                                inode;
+#endif /* INI_HAS_MMAP */
+};
+
+/**
+ * Returns true if the file of `file` is already being loaded by one of
+ * its parents. Files are compared by their device and inode numbers
+ * where they are known, so different paths to one file are found too.
+*/
+static bool ini_overlay_is_loading(const struct ini_overlay_loading *file)
+{
+    const struct ini_overlay_loading *parent;
+
+    for (parent = file->parent; parent != NULL; parent = parent->parent) {
+#ifdef INI_HAS_MMAP
+        if (parent->device == file->device && parent->inode == file->inode)
+            return true;
+#else
+        if (strcmp(parent->path, file->path) == 0)
+            return true;
+#endif /* INI_HAS_MMAP */
+    }
+
+    return false;
+}
+
+static bool ini_overlay_load_at(ini_overlay_t overlay, const char *path,
+                                const struct ini_overlay_loading *parent,
+                                unsigned depth)
+{
+    struct ini_overlay_loading file;
+    struct ini_key_iter iter;
+    struct ini_map *includes;
+    bool result = true;
+    char *include;
+    ini_t ini;
+#ifdef INI_HAS_MMAP
+    struct stat st;
+
+    if (stat(path, &st) != 0)
+        return false;
+
+    file.device = (uint64_t) st.st_dev;
+    file.inode = (uint64_t) st.st_ino;
+#endif /* INI_HAS_MMAP */
+
+    file.path = path;
+    file.parent = parent;
+
+    if (depth > INI_OVERLAY_MAX_DEPTH || ini_overlay_is_loading(&file)) {
+#ifdef ELOOP
+        errno = ELOOP;
+#endif /* ELOOP */
+        return false;
+    }
+
+    if ((ini = ini_parse_from_path(path)) == NULL)
+        return false;
+
+    includes = (struct ini_map*) ini_map_get(ini, INI_INCLUDE_SECTION_NAME);
+    ini_key_iter_init(&iter, includes);
+
+    while (result && ini_key_iter_next(&iter)) {
+        if (iter.value == NULL || *iter.value == '\0')
+            continue;
+
+        if ((include = ini_overlay_path(path, iter.value)) == NULL)
+            result = false;
+        else
+            result = ini_overlay_load_at(overlay, include, &file, depth + 1);
+
+        ini_deallocate(NULL, include);
+    }
+
+    if (!result) {
+        ini_free(ini);
+        return false;
+    }
+
+    return ini_overlay_push_layer(overlay, ini, includes);
+}
+
+/**
+ * Parses the file at `path` and puts it on top of the layers of
+ * `overlay`. Every value of its `[include]` section is the path of
+ * another file, relative to the directory of `path` unless it is
+ * absolute, which is loaded the same way first, so the file overrides
+ * its includes and later includes override earlier ones:
  * 
- * WARNING: The string must end with `\0`, otherwise it may lead to
- * undefined behavior.
+ *     [include]
+ *     base = base.ini
+ *     env = production.ini
+ * 
+ * The `[include]` section itself is not seen by `ini_overlay_get`
+ * and is left out of `ini_overlay_materialize`.
+ * 
+ * Includes may be nested up to INI_OVERLAY_MAX_DEPTH levels. Returns
+ * false if a file can't be read, or includes itself directly or
+ * through other files (with `errno` set to ELOOP where it exists), in
+ * which case none of the layers loaded by this call are kept.
 */
-static ini_t ini_parse_from_str(const char *str)
+static bool ini_overlay_load(ini_overlay_t overlay, const char *path)
 {
-    struct ini_parse_state state = {0};
-    struct ini_io io = {0};
+    size_t count;
 
-    io.eof = ini_io_string_eof;
-    io.getc = ini_io_string_getc;
-    io.raw = (void*) str;
-    io.mode = INI_IO_MODE_READ;
+    if (overlay == NULL || path == NULL)
+        return false;
 
-    return ini_parse(&io, &state);
+    count = overlay->count;
+
+    if (ini_overlay_load_at(overlay, path, NULL, 0))
+        return true;
+
+    while (overlay->count > count)
+        ini_free(overlay->layers[--overlay->count].ini);
+
+    ini_overlay_invalidate(overlay);
+    return false;
 }
 
 /**
- * Creates an ini structure from data read from an open file stream.
+ * Finds the key `key` of `key_size` bytes in the section `section` of
+ * `section_size` bytes in the highest layer of `overlay` that has it,
+ * with the names hashed by `ini_hash` once for all layers. Stores the
+ * entry of the section in `sec` and returns the entry of the key, or
+ * NULL if no layer has the key.
 */
-static ini_t ini_parse_from_file(FILE *fp)
+static struct ini_map_entry*
+ini_overlay_find(ini_overlay_t overlay, const char *section,
+                 size_t section_size, const char *key, size_t key_size,
+                 struct ini_map_entry **sec)
 {
-    struct ini_parse_state state = {0};
-    struct ini_io io = {0};
+    uint64_t section_hash = ini_hash(section, section_size);
+    uint64_t key_hash = ini_hash(key, key_size);
+    struct ini_map_entry *entry;
+    size_t i;
 
-    io.eof = ini_io_file_eof;
-    io.getc = ini_io_file_getc;
-    io.raw = (void*) fp;
-    io.mode = INI_IO_MODE_READ;
+    for (i = overlay->count; i-- > 0;) {
+        if (overlay->layers[i].ini->size == 0)
+            continue;
 
-    return ini_parse(&io, &state);
+        *sec = ini_map_find(overlay->layers[i].ini, section_hash, section,
+                            section_size);
+
+        if (*sec == NULL || (*sec)->value == NULL
+            || (*sec)->value == overlay->layers[i].includes)
+        {
+            continue;
+        }
+
+        entry = ini_map_find((struct ini_map*) (*sec)->value, key_hash, key,
+                             key_size);
+
+        if (entry != NULL)
+            return entry;
+    }
+
+    return NULL;
 }
 
 /**
- * Creates an ini structure from data read from a file at the given
- * path.
+ * Resolves the `key` of the specified section through the layers of
+ * `overlay`, starting from the highest one, into a handle that can be
+ * read with `ini_get_h` or `ini_get_typed_h`. Returns NULL if no layer
+ * has the key.
+ * 
+ * Resolved keys are cached by the addresses of `section` and `key`, so
+ * a lookup with the same pointers, such as string literals, only
+ * compares the names with those of the cached entry, without hashing
+ * them or searching the layers.
+ * 
+ * If `section` is NULL, then the default `INI_DEFAULT_SECTION_NAME`
+ * constant will be used.
 */
-static ini_t ini_parse_from_path(const char *path)
+static ini_handle_t
+ini_overlay_lookup(ini_overlay_t overlay, const char *section,
+                   const char *key)
 {
-    ini_t tmp = NULL;
-    FILE *fp = fopen(path, "r");
+    const char *section_name = section ? section : INI_DEFAULT_SECTION_NAME;
+    struct ini_map_entry *sec, *entry;
+    struct ini_overlay_slot *slot;
+    uint64_t index;
+
+    if (overlay == NULL || key == NULL)
+        return NULL;
+
+    index = ini_mix((uint64_t) (uintptr_t) section_name ^ INI_WY_SECRET2,
+                    (uint64_t) (uintptr_t) key);
+    slot = &overlay->cache[index & (INI_OVERLAY_CACHE_SIZE - 1)];
+
+    /* The caller may have changed the strings behind the same pointers */
+    if (slot->entry != NULL && slot->key_name == key
+        && slot->section_name == section_name
+        && strcmp(slot->entry->key, key) == 0
+        && strcmp(slot->section->key, section_name) == 0)
+    {
+        return slot->entry;
+    }
 
-    if (fp != NULL) {
-        tmp = ini_parse_from_file(fp);
-        fclose(fp);
+    entry = ini_overlay_find(overlay, section_name, strlen(section_name),
+                             key, strlen(key), &sec);
+
+    if (entry != NULL) {
+        slot->section_name = section_name;
+        slot->key_name = key;
+        slot->section = sec;
+        slot->entry = entry;
     }
 
-    return tmp;
+    return entry;
 }
 
 /**
- * Saves the contents of the ini structure to an open file stream.
+ * Same as `ini_get`, but for the layers of `overlay`: returns the value
+ * of the key `key` in the `section` of the highest layer that has it,
+ * otherwise returns the value `def`.
 */
-static void ini_store_to_file(ini_t ini, FILE *fp)
+static const char *ini_overlay_get(ini_overlay_t overlay, const char *section,
+                                   const char *key, const char *def)
 {
-    struct ini_io io = {0};
-    io.putc = ini_io_file_putc;
-    io.raw = (void*) fp;
-    io.mode = INI_IO_MODE_WRITE;
-    
-    ini_store(ini, &io);
+    return ini_get_h(ini_overlay_lookup(overlay, section, key), def);
 }
 
 /**
- * Saves the contents of the ini structure to a file at the specified
- * path.
+ * Sets the `key` of the specified section in the highest layer of
+ * `overlay`, so it overrides all layers. Does nothing if there are no
+ * layers.
 */
-static void ini_store_to_path(ini_t ini, const char *path)
+static void ini_overlay_set(ini_overlay_t overlay, const char *section,
+                            const char *key, const char *value)
 {
-    FILE *fp;
+    if (overlay != NULL && overlay->count > 0) {
+        ini_set(overlay->layers[overlay->count - 1].ini, section, key,
+                value);
+        ini_overlay_invalidate(overlay);
+    }
+}
 
-    if ((fp = fopen(path, "w")) != NULL) {
-        ini_store_to_file(ini, fp);
-        fclose(fp);
+/**
+ * Creates a new `ini_t` with the keys of all layers of `overlay`, as
+ * if the layers were parsed one after another from the lowest. The
+ * overlay is left as it is. Returns NULL on error.
+ * 
+ * WARNING: Don't forget to free memory with `ini_free`
+*/
+static ini_t ini_overlay_materialize(ini_overlay_t overlay)
+{
+    struct ini_section_iter sections;
+    struct ini_key_iter keys;
+    struct ini_map *section;
+    ini_t ini;
+    size_t i;
+
+    if (overlay == NULL || (ini = ini_new()) == NULL)
+        return NULL;
+
+    for (i = 0; i < overlay->count; ++i) {
+        ini_section_iter_init(&sections, overlay->layers[i].ini);
+
+        while (ini_section_iter_next(&sections)) {
+            if (sections.section == overlay->layers[i].includes)
+                continue;
+
+            section = ini_section_n(ini, sections.name, sections.size);
+
+            if (section == NULL) {
+                ini_free(ini);
+                return NULL;
+            }
+
+            ini_key_iter_init(&keys, sections.section);
+
+            while (ini_key_iter_next(&keys)) {
+                if (!ini_map_insert_string(section, keys.key, keys.size,
+                                           keys.value, keys.value
+                                           ? strlen(keys.value) : 0))
+                {
+                    ini_free(ini);
+                    return NULL;
+                }
+            }
+        }
     }
+
+    return ini;
 }
 
-#ifdef _cplusplus
+#ifdef __cplusplus
 }
-#endif /* _cplusplus */
+#endif /* __cplusplus */
 
 #endif /* INI_H_INCLUDED */
\ No newline at end of file
@@ -0,0 +1,610 @@
+/*  ____  ____   ____   Copyright (c) 2023 adasdead
+ * |    ||  _ \ |    |  This software is licensed under the MIT License.
+ *  |  | |  |  | |  |   Header-only C/C++ INI library
+ * |____||__|__||____|  https://github.com/adasdead/ini
+*/
+
+#ifndef INI_HPP_INCLUDED
+#define INI_HPP_INCLUDED
+
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <new>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "ini.h"
+
+#if __cplusplus < 201703L && (!defined(_MSVC_LANG) || _MSVC_LANG < 201703L)
+#error "ini.hpp requires C++17"
+#endif
+
+namespace ini {
+
+namespace detail {
+
+/**
+ * Same as `ini_mum`, in a form that can be evaluated at compile time.
+*/
+constexpr void mum(std::uint64_t &a, std::uint64_t &b) noexcept
+{
+    std::uint64_t ha = a >> 32, hb = b >> 32;
+    std::uint64_t la = static_cast<std::uint32_t>(a);
+    std::uint64_t lb = static_cast<std::uint32_t>(b);
+    std::uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    std::uint64_t t = rl + (rm0 << 32), carry = (t < rl);
+    std::uint64_t lo = t + (rm1 << 32);
+
+    carry += (lo < t);
+    a = lo;
+    b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+}
+
+constexpr std::uint64_t mix(std::uint64_t a, std::uint64_t b) noexcept
+{
+    mum(a, b);
+    return a ^ b;
+}
+
+constexpr std::uint64_t read32(std::string_view str, std::size_t i) noexcept
+{
+    return static_cast<std::uint64_t>(static_cast<unsigned char>(str[i]))
+         | static_cast<std::uint64_t>(static_cast<unsigned char>(str[i + 1])) << 8
+         | static_cast<std::uint64_t>(static_cast<unsigned char>(str[i + 2])) << 16
+         | static_cast<std::uint64_t>(static_cast<unsigned char>(str[i + 3])) << 24;
+}
+
+constexpr std::uint64_t read64(std::string_view str, std::size_t i) noexcept
+{
+    return read32(str, i) | read32(str, i + 4) << 32;
+}
+
+/**
+ * Same as `ini_wyhash_mixed`, in a form that can be evaluated at
+ * compile time.
+*/
+constexpr std::uint64_t
+wyhash_mixed(std::string_view str, std::uint64_t seed) noexcept
+{
+    std::size_t size = str.size(), i = size, p = 0;
+    std::uint64_t a = 0, b = 0, see1 = 0, see2 = 0;
+
+    if (size <= 16) {
+        if (size >= 4) {
+            a = (read32(str, 0) << 32) | read32(str, (size >> 3) << 2);
+            b = (read32(str, size - 4) << 32)
+              | read32(str, size - 4 - ((size >> 3) << 2));
+        }
+        else if (size > 0) {
+            a = static_cast<std::uint64_t>(static_cast<unsigned char>(str[0])) << 16
+              | static_cast<std::uint64_t>(static_cast<unsigned char>(str[size >> 1])) << 8
+              | static_cast<std::uint64_t>(static_cast<unsigned char>(str[size - 1]));
+        }
+    }
+    else {
+        if (i > 48) {
+            see1 = see2 = seed;
+
+            do {
+                seed = mix(read64(str, p) ^ INI_WY_SECRET1,
+                           read64(str, p + 8) ^ seed);
+                see1 = mix(read64(str, p + 16) ^ INI_WY_SECRET2,
+                           read64(str, p + 24) ^ see1);
+                see2 = mix(read64(str, p + 32) ^ INI_WY_SECRET3,
+                           read64(str, p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+
+            seed ^= see1 ^ see2;
+        }
+
+        while (i > 16) {
+            seed = mix(read64(str, p) ^ INI_WY_SECRET1,
+                       read64(str, p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+
+        a = read64(str, p + i - 16);
+        b = read64(str, p + i - 8);
+    }
+
+    a ^= INI_WY_SECRET1;
+    b ^= seed;
+    mum(a, b);
+    return mix(a ^ INI_WY_SECRET0 ^ size, b ^ INI_WY_SECRET1);
+}
+
+} // namespace detail
+
+/**
+ * Returns the same hash as `ini_hash`, and can be evaluated at compile
+ * time.
+*/
+constexpr std::uint64_t hash(std::string_view str) noexcept
+{
+    const std::uint64_t seed = static_cast<std::uint64_t>(INI_HASH_SEED);
+
+    return detail::wyhash_mixed(str, seed ^ detail::mix(
+        seed ^ INI_WY_SECRET0, INI_WY_SECRET1));
+}
+
+/**
+ * Section or key name together with its hash. A `constexpr ini::name`,
+ * or one made by `INI_NAME`, is hashed at compile time:
+ *
+ *     constexpr ini::name database("database");
+ *     doc.get<int>(database, INI_NAME("port"));
+ *
+ * Names made from strings at run time are hashed when they are made.
+ *
+ * WARNING: The name refers to the string and doesn't copy it.
+*/
+struct name {
+    std::string_view                        view;
+    std::uint64_t                           hash;
+
+    constexpr name(std::string_view str) noexcept
+        : view(str), hash(ini::hash(str)) {}
+
+    constexpr name(const char *str) noexcept
+        : name(std::string_view(str)) {}
+
+    name(const std::string &str) noexcept
+        : name(std::string_view(str)) {}
+
+    constexpr name(std::string_view str, std::uint64_t str_hash) noexcept
+        : view(str), hash(str_hash) {}
+};
+
+/**
+ * Makes an `ini::name` of a string literal whose hash is computed at
+ * compile time, even where the name itself isn't a constant.
+*/
+#define INI_NAME(str)                                                       \
+    (::ini::name(std::string_view(str),                                     \
+        std::integral_constant<std::uint64_t, ::ini::hash(str)>::value))
+
+/**
+ * The section of the keys that come before any section line.
+*/
+inline constexpr name default_section{INI_DEFAULT_SECTION_NAME};
+
+/**
+ * Value in bytes with an optional `k`, `M`, `G` or `T` suffix, see
+ * `ini_get_size`. Use it as `doc.get<ini::bytes>(...)`.
+*/
+struct bytes {
+    std::size_t                             value;
+};
+
+namespace detail {
+
+inline std::size_t istream_read(ini_io *io, char *buf, std::size_t n)
+{
+    std::istream &in = *static_cast<std::istream*>(io->raw);
+
+    in.read(buf, static_cast<std::streamsize>(n));
+    return static_cast<std::size_t>(in.gcount());
+}
+
+inline int istream_getc(ini_io *io)
+{
+    std::istream &in = *static_cast<std::istream*>(io->raw);
+    std::istream::int_type ch = in.get();
+
+    io->peek = std::istream::traits_type::eq_int_type(ch, EOF)
+             ? static_cast<char>(EOF) : static_cast<char>(ch);
+    return in ? static_cast<unsigned char>(ch) : EOF;
+}
+
+inline bool istream_eof(ini_io *io)
+{
+    return !*static_cast<std::istream*>(io->raw);
+}
+
+inline void ostream_write(ini_io *io, const char *buf, std::size_t n)
+{
+    std::ostream &out = *static_cast<std::ostream*>(io->raw);
+    out.write(buf, static_cast<std::streamsize>(n));
+}
+
+inline void ostream_putc(ini_io *io, int ch)
+{
+    static_cast<std::ostream*>(io->raw)->put(static_cast<char>(ch));
+}
+
+} // namespace detail
+
+/**
+ * Owner of an `ini_t`, which is freed with the document. Documents can
+ * be moved but not copied.
+ *
+ * Lookups take `ini::name`, so string literals and `std::string_view`
+ * are passed without `strlen`. Values are returned as views into the
+ * document, which stay valid until the key is changed or the document
+ * is destroyed.
+*/
+class document {
+public:
+    /**
+     * Creates an empty document. Throws `std::bad_alloc` if out of
+     * memory.
+    */
+    document() : ini_(ini_new())
+    {
+        if (ini_ == nullptr)
+            throw std::bad_alloc();
+    }
+
+    /**
+     * Takes ownership of `ini`, which may be NULL.
+    */
+    explicit document(ini_t ini) noexcept : ini_(ini) {}
+
+    document(const document&) = delete;
+    document &operator=(const document&) = delete;
+
+    document(document &&other) noexcept
+        : ini_(std::exchange(other.ini_, nullptr)) {}
+
+    document &operator=(document &&other) noexcept
+    {
+        if (this != &other) {
+            ini_free(ini_);
+            ini_ = std::exchange(other.ini_, nullptr);
+        }
+
+        return *this;
+    }
+
+    ~document()
+    {
+        ini_free(ini_);
+    }
+
+    /**
+     * Parses `text`, which doesn't have to end with `\0`. The document
+     * is empty (false) on error.
+    */
+    static document parse(std::string_view text)
+    {
+        return document(ini_parse_from_buffer(text.data(), text.size()));
+    }
+
+    /**
+     * Parses the file at `path`. The document is empty (false) if the
+     * file can't be read.
+    */
+    static document load(const std::string &path)
+    {
+        return document(ini_parse_from_path(path.c_str()));
+    }
+
+    /**
+     * Parses the rest of `in`, reading it in blocks with
+     * `std::istream::read`. The document is empty (false) on error.
+    */
+    static document read(std::istream &in)
+    {
+        document doc;
+
+        if (!doc.read_from(in))
+            return document(nullptr);
+
+        return doc;
+    }
+
+    /**
+     * Parses the rest of `in` into this document. Keys before the
+     * first section header of `in` go to the default section, not to
+     * the last section of the document, and keys that are already in
+     * the document are overwritten. Returns false on error.
+    */
+    bool read_from(std::istream &in)
+    {
+        ini_parse_state state = {};
+        ini_io io = {};
+
+        if (ini_ == nullptr && (ini_ = ini_new()) == nullptr)
+            return false;
+
+        io.raw = static_cast<void*>(&in);
+        io.mode = INI_IO_MODE_READ;
+        io.read = detail::istream_read;
+        io.getc = detail::istream_getc;
+        io.eof = detail::istream_eof;
+
+        state.ini = ini_;
+        return ini_parse(&io, &state) != nullptr && !in.bad();
+    }
+
+    /**
+     * Writes the document to `out` in blocks with `std::ostream::write`.
+    */
+    void write(std::ostream &out) const
+    {
+        ini_io io = {};
+
+        io.raw = static_cast<void*>(&out);
+        io.mode = INI_IO_MODE_WRITE;
+        io.write = detail::ostream_write;
+        io.putc = detail::ostream_putc;
+
+        ini_store(ini_, &io);
+    }
+
+    /**
+     * Writes the document to the file at `path`.
+    */
+    void save(const std::string &path) const
+    {
+        ini_store_to_path(ini_, path.c_str());
+    }
+
+    /**
+     * Returns the document as a string, which is allocated once with
+     * the exact size of the output.
+    */
+    std::string str() const
+    {
+        std::string out(ini_store_size(ini_), '\0');
+        ini_writer writer = {};
+
+        writer.buffer = out.data();
+        writer.capacity = out.size();
+
+        if (ini_ != nullptr)
+            ini_store_to(&writer, ini_);
+
+        return out;
+    }
+
+    /**
+     * Returns the handle of `key` in `section`, or NULL if there is no
+     * such key.
+    */
+    ini_handle_t lookup(const name &section, const name &key) const noexcept
+    {
+        return ini_lookup_hashed(ini_, section.view.data(),
+                                 section.view.size(), section.hash,
+                                 key.view.data(), key.view.size(),
+                                 key.hash);
+    }
+
+    bool contains(const name &section, const name &key) const noexcept
+    {
+        ini_handle_t handle = lookup(section, key);
+        return handle != nullptr && ini_get_h(handle, nullptr) != nullptr;
+    }
+
+    /**
+     * Converts the value of `key` in `section` to `T` and stores it in
+     * `out`. Returns INI_OK, or the error and leaves `out` unchanged.
+     *
+     * `T` may be `std::string_view`, `std::string`, `const char*`,
+     * `bool`, any other arithmetic type or `ini::bytes`. Numbers that
+     * don't fit into `T` give INI_ERROR_RANGE.
+    */
+    template<typename T>
+    ini_status get(const name &section, const name &key, T &out) const
+    {
+        return convert(lookup(section, key), out);
+    }
+
+    /**
+     * Returns the value of `key` in `section` converted to `T`, or
+     * `std::nullopt` if it is missing or can't be converted.
+    */
+    template<typename T = std::string_view>
+    std::optional<T> get(const name &section, const name &key) const
+    {
+        T value{};
+
+        if (get(section, key, value) != INI_OK)
+            return std::nullopt;
+
+        return value;
+    }
+
+    /**
+     * Returns the value of `key` in `section` converted to `T`, or
+     * `def` if it is missing or can't be converted.
+    */
+    template<typename T>
+    T get_or(const name &section, const name &key, T def) const
+    {
+        get(section, key, def);
+        return def;
+    }
+
+    /**
+     * Sets `key` in `section` to a copy of `value`.
+    */
+    void set(std::string_view section, std::string_view key,
+             std::string_view value)
+    {
+        ini_set_n(ini_, section.data(), section.size(), key.data(),
+                  key.size(), value.data(), value.size());
+    }
+
+    /**
+     * Same as `ini_set`: a NULL `value` leaves `key` without a value,
+     * so it is reported as missing.
+    */
+    void set(std::string_view section, std::string_view key,
+             const char *value)
+    {
+        if (value == nullptr)
+            ini_set_n(ini_, section.data(), section.size(), key.data(),
+                      key.size(), nullptr, 0);
+        else
+            set(section, key, std::string_view(value));
+    }
+
+    void set(std::string_view section, std::string_view key,
+             const std::string &value)
+    {
+        set(section, key, std::string_view(value));
+    }
+
+    /**
+     * Sets `key` in `section` to the text of the number or bool
+     * `value`. Floating-point numbers are written in the shortest form
+     * that reads back as the same number. Characters are not numbers
+     * here, pass them as strings.
+    */
+    template<typename T,
+             typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+    void set(std::string_view section, std::string_view key, T value)
+    {
+        static_assert(!is_character_v<T>,
+                      "pass characters to ini::document::set as strings");
+
+        if constexpr (std::is_same_v<T, bool>) {
+            set(section, key, std::string_view(value ? "true" : "false"));
+        }
+        else {
+            char buffer[128];
+            std::to_chars_result result =
+                std::to_chars(buffer, buffer + sizeof buffer, value);
+
+            set(section, key, std::string_view(buffer, static_cast<
+                std::size_t>(result.ptr - buffer)));
+        }
+    }
+
+    ini_t native_handle() const noexcept
+    {
+        return ini_;
+    }
+
+    /**
+     * Gives up ownership of the `ini_t`, which must then be freed with
+     * `ini_free`.
+    */
+    ini_t release() noexcept
+    {
+        return std::exchange(ini_, nullptr);
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return ini_ != nullptr;
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const document &doc)
+    {
+        doc.write(out);
+        return out;
+    }
+
+    friend std::istream &operator>>(std::istream &in, document &doc)
+    {
+        if (!doc.read_from(in))
+            in.setstate(std::ios::failbit);
+
+        return in;
+    }
+
+private:
+    template<typename T>
+    static constexpr bool is_character_v =
+        std::is_same_v<T, char> || std::is_same_v<T, wchar_t>
+        || std::is_same_v<T, char16_t> || std::is_same_v<T, char32_t>;
+
+    /**
+     * Converts the value of `handle` without caching the result in the
+     * entry, see `ini_convert_typed`, so that concurrent calls on a
+     * `const document` don't write to it.
+    */
+    template<typename T>
+    static ini_status convert(ini_handle_t handle, T &out)
+    {
+        const char *value = ini_get_h(handle, nullptr);
+        union ini_number number = {};
+        ini_status status;
+
+        if (value == nullptr)
+            return INI_ERROR_MISSING;
+
+        if constexpr (std::is_same_v<T, std::string_view>
+                      || std::is_same_v<T, std::string>
+                      || std::is_same_v<T, const char*>) {
+            out = T(value);
+            return INI_OK;
+        }
+        else if constexpr (std::is_same_v<T, bool>) {
+            status = ini_convert_typed(value, INI_TYPE_BOOL, &number);
+
+            if (status == INI_OK)
+                out = number.b;
+
+            return status;
+        }
+        else if constexpr (std::is_same_v<T, bytes>) {
+            status = ini_convert_typed(value, INI_TYPE_SIZE, &number);
+
+            if (status == INI_OK)
+                out.value = number.size;
+
+            return status;
+        }
+        else if constexpr (std::is_floating_point_v<T>) {
+            status = ini_convert_typed(value, INI_TYPE_DOUBLE, &number);
+
+            if (status != INI_OK)
+                return status;
+
+            if (std::isfinite(number.d)
+                && std::fabs(number.d) > std::numeric_limits<T>::max())
+            {
+                return INI_ERROR_RANGE;
+            }
+
+            out = static_cast<T>(number.d);
+            return INI_OK;
+        }
+        else if constexpr (std::is_integral_v<T>) {
+            status = ini_convert_typed(value, INI_TYPE_INT, &number);
+
+            if (status != INI_OK)
+                return status;
+
+            if (!fits<T>(number.i))
+                return INI_ERROR_RANGE;
+
+            out = static_cast<T>(number.i);
+            return INI_OK;
+        }
+        else {
+            static_assert(!sizeof(T), "unsupported type for ini::document::get");
+        }
+    }
+
+    template<typename T>
+    static constexpr bool fits(long long value) noexcept
+    {
+        if constexpr (std::is_signed_v<T>)
+            return value >= static_cast<long long>(std::numeric_limits<T>::min())
+                && value <= static_cast<long long>(std::numeric_limits<T>::max());
+        else
+            return value >= 0 && static_cast<unsigned long long>(value)
+                <= static_cast<unsigned long long>(std::numeric_limits<T>::max());
+    }
+
+    ini_t                                   ini_;
+};
+
+} // namespace ini
+
+#endif /* INI_HPP_INCLUDED */
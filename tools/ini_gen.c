@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ini.h"
+
+/**
+ * Turns an INI file into a C source with the frozen snapshot of it,
+ * see `ini_freeze`. The snapshot is written as a static const struct
+ * whose members are the tables of the snapshot, with every number as
+ * a literal, so it ends up in `.rodata` and doesn't depend on the byte
+ * order of the machine that generated it.
+*/
+
+static const char *usage =
+    "usage: %s <input.ini> <name> [output.c]\n"
+    "Writes `const struct ini_frozen *const <name>`, which can be read\n"
+    "with ini_frozen_get, to output.c or to stdout. The program that\n"
+    "uses it must be built with the same INI_HASH_SEED as ini_gen.\n";
+
+#define MAX_LITERAL 4095
+
+/* Number of 4-byte entries of a table padded to a multiple of 8 bytes */
+#define PADDED(count, size) ((((count) * (size) + 7) & ~(size_t) 7) / (size))
+
+static int valid_name(const char *name)
+{
+    const char *p = name;
+
+    if (*p == '\0' || (*p >= '0' && *p <= '9'))
+        return 0;
+
+    for (; *p != '\0'; ++p) {
+        if (!(*p == '_' || (*p >= '0' && *p <= '9')
+              || ((*p | 0x20) >= 'a' && (*p | 0x20) <= 'z')))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void write_u32_table(FILE *out, const char *member,
+                            const uint32_t *table, size_t count,
+                            size_t padded)
+{
+    size_t i;
+
+    fprintf(out, "    /* %s */\n    {", member);
+
+    for (i = 0; i < padded; ++i) {
+        if (i % 8 == 0)
+            fprintf(out, "\n        ");
+
+        fprintf(out, "%luu%s", i < count ? (unsigned long) table[i] : 0ul,
+                i + 1 < padded ? ", " : "");
+    }
+
+    fprintf(out, "\n    },\n");
+}
+
+/**
+ * Writes `size` bytes of `str` as string literals of up to 64 bytes
+ * per line. Every character that isn't printable is written as a
+ * three-digit octal escape, so it can't run into the next digit.
+ * 
+ * C99 compilers only have to support string literals of up to 4095
+ * bytes, so longer tables are written as lists of numbers.
+*/
+static void write_strings(FILE *out, const char *str, size_t size)
+{
+    size_t i;
+    int ch;
+
+    fprintf(out, "    /* strings */\n");
+
+    if (size > MAX_LITERAL) {
+        fprintf(out, "    {");
+
+        for (i = 0; i < size; ++i) {
+            fprintf(out, "%s%d%s", i % 16 == 0 ? "\n        " : "",
+                    (int) (unsigned char) str[i], i + 1 < size ? ", " : "");
+        }
+
+        fprintf(out, "\n    }\n");
+        return;
+    }
+
+    fprintf(out, "    \"");
+
+    for (i = 0; i < size; ++i) {
+        if (i > 0 && i % 64 == 0)
+            fprintf(out, "\"\n    \"");
+
+        ch = (unsigned char) str[i];
+
+        /* The last `\0` is added by the compiler */
+        if (i + 1 == size && ch == '\0')
+            break;
+
+        if (ch == '"' || ch == '\\' || ch == '?')
+            fprintf(out, "\\%c", ch);
+        else if (ch >= 0x20 && ch < 0x7f)
+            fputc(ch, out);
+        else
+            fprintf(out, "\\%03o", ch);
+    }
+
+    fprintf(out, "\"\n");
+}
+
+static void write_source(FILE *out, ini_frozen_t frozen, const char *input,
+                         const char *name)
+{
+    const struct ini_frozen_key *keys;
+    const struct ini_frozen_section *sections;
+    size_t strings = (size_t) frozen->size - frozen->strings, i;
+
+    keys = ini_frozen_table(frozen, struct ini_frozen_key, slots);
+    sections = ini_frozen_table(frozen, struct ini_frozen_section, sections);
+
+    fprintf(out, "/* Generated by ini_gen from %s. Don't edit. */\n\n", input);
+    fprintf(out, "#include \"ini.h\"\n\n");
+
+    fprintf(out, "/* The layout below is that of snapshot version %lu, and "
+                 "the keys are\n   hashed with INI_HASH_SEED 0x%llx */\n",
+            (unsigned long) INI_FROZEN_VERSION,
+            (unsigned long long) frozen->seed);
+    fprintf(out, "typedef char %s_version_check[INI_FROZEN_VERSION == %lu "
+                 "? 1 : -1];\n", name, (unsigned long) INI_FROZEN_VERSION);
+
+    /* ini_frozen_get hashes with the INI_HASH_SEED of the program */
+    fprintf(out, "typedef char %s_seed_check[(uint64_t) INI_HASH_SEED == "
+                 "UINT64_C(0x%llx) ? 1 : -1];\n\n", name,
+            (unsigned long long) frozen->seed);
+
+    fprintf(out, "static const struct {\n");
+    fprintf(out, "    struct ini_frozen header;\n");
+    fprintf(out, "    struct ini_frozen_key slots[%lu];\n",
+            (unsigned long) frozen->slot_count);
+
+    if (frozen->section_count > 0)
+        fprintf(out, "    struct ini_frozen_section sections[%lu];\n",
+                (unsigned long) frozen->section_count);
+
+    fprintf(out, "    uint32_t buckets[%lu];\n",
+            (unsigned long) PADDED(frozen->bucket_count, sizeof(uint32_t)));
+
+    if (frozen->key_count > 0)
+        fprintf(out, "    uint32_t order[%lu];\n",
+                (unsigned long) PADDED(frozen->key_count, sizeof(uint32_t)));
+
+    fprintf(out, "    char strings[%lu];\n", (unsigned long)
+            (strings > 0 ? strings : 1));
+    fprintf(out, "} %s_data = {\n", name);
+
+    /* Same order as the members of `struct ini_frozen` */
+    fprintf(out, "    {\n");
+    fprintf(out, "        %luu, %luu, UINT64_C(%llu), UINT64_C(0x%llx),\n",
+            (unsigned long) frozen->magic, (unsigned long) frozen->version,
+            (unsigned long long) frozen->size,
+            (unsigned long long) frozen->seed);
+    fprintf(out, "        %luu, %luu, %luu, %luu,\n",
+            (unsigned long) frozen->section_count,
+            (unsigned long) frozen->key_count,
+            (unsigned long) frozen->bucket_count,
+            (unsigned long) frozen->slot_count);
+    fprintf(out, "        %luu, %luu, %luu, %luu, %luu, 0u,\n",
+            (unsigned long) frozen->slots, (unsigned long) frozen->sections,
+            (unsigned long) frozen->buckets, (unsigned long) frozen->order,
+            (unsigned long) frozen->strings);
+    fprintf(out, "        UINT64_C(0x%llx), %lld, UINT64_C(%llu)\n",
+            (unsigned long long) ini_frozen_checksum(frozen),
+            (long long) frozen->source_mtime,
+            (unsigned long long) frozen->source_size);
+    fprintf(out, "    },\n");
+
+    fprintf(out, "    /* slots */\n    {\n");
+
+    for (i = 0; i < frozen->slot_count; ++i) {
+        fprintf(out, "        { UINT64_C(0x%016llx), %luu, %luu, %luu, "
+                     "%luu, %luu, 0u }%s\n",
+                (unsigned long long) keys[i].hash,
+                (unsigned long) keys[i].section, (unsigned long) keys[i].key,
+                (unsigned long) keys[i].key_size,
+                (unsigned long) keys[i].value,
+                (unsigned long) keys[i].value_size,
+                i + 1 < frozen->slot_count ? "," : "");
+    }
+
+    fprintf(out, "    },\n");
+
+    if (frozen->section_count > 0) {
+        fprintf(out, "    /* sections */\n    {\n");
+
+        for (i = 0; i < frozen->section_count; ++i) {
+            fprintf(out, "        { %luu, %luu, %luu, %luu }%s\n",
+                    (unsigned long) sections[i].name,
+                    (unsigned long) sections[i].size,
+                    (unsigned long) sections[i].first,
+                    (unsigned long) sections[i].count,
+                    i + 1 < frozen->section_count ? "," : "");
+        }
+
+        fprintf(out, "    },\n");
+    }
+
+    write_u32_table(out, "buckets",
+                    ini_frozen_table(frozen, uint32_t, buckets),
+                    frozen->bucket_count,
+                    PADDED(frozen->bucket_count, sizeof(uint32_t)));
+
+    if (frozen->key_count > 0) {
+        write_u32_table(out, "order",
+                        ini_frozen_table(frozen, uint32_t, order),
+                        frozen->key_count,
+                        PADDED(frozen->key_count, sizeof(uint32_t)));
+    }
+
+    write_strings(out, ini_frozen_string(frozen, 0), strings);
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "extern const struct ini_frozen *const %s;\n", name);
+    fprintf(out, "const struct ini_frozen *const %s = &%s_data.header;\n",
+            name, name);
+}
+
+int main(int argc, char **argv)
+{
+    ini_frozen_t frozen;
+    FILE *out = stdout;
+    ini_t ini;
+
+    if (argc < 3) {
+        fprintf(stderr, usage, argv[0]);
+        return 2;
+    }
+
+    if (!valid_name(argv[2])) {
+        fprintf(stderr, "not a C identifier: %s\n", argv[2]);
+        return 2;
+    }
+
+    if ((ini = ini_parse_from_path(argv[1])) == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    frozen = ini_freeze(ini);
+    ini_free(ini);
+
+    if (frozen == NULL) {
+        fprintf(stderr, "%s: can't build the perfect hash\n", argv[1]);
+        return 1;
+    }
+
+    if (argc > 3 && (out = fopen(argv[3], "w")) == NULL) {
+        perror(argv[3]);
+        ini_frozen_free(frozen);
+        return 1;
+    }
+
+    write_source(out, frozen, argv[1], argv[2]);
+
+    if (out != stdout)
+        fclose(out);
+
+    ini_frozen_free(frozen);
+    return 0;
+}